@@ -0,0 +1,32 @@
+#ifndef bench_hh_INCLUDED
+#define bench_hh_INCLUDED
+
+#include <chrono>
+#include <cstddef>
+
+namespace Kakoune
+{
+
+namespace Bench
+{
+
+// prevents the compiler from discarding the measured results
+static volatile size_t sink;
+
+// returns the mean duration of func in milliseconds, after a warm up run
+template<typename Func>
+double measure(Func func, int runs = 5)
+{
+    using Clock = std::chrono::steady_clock;
+    func();
+    const auto start = Clock::now();
+    for (int i = 0; i < runs; ++i)
+        func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+}
+
+}
+
+}
+
+#endif // bench_hh_INCLUDED
@@ -0,0 +1,90 @@
+// Compares find_diff_hashed to find_diff on the lines of large texts, as
+// Buffer::reload diffs them, and find_text_diff to a bytewise find_diff
+// of whole texts, as pipe outputs used to be diffed, with changes more or
+// less far apart.
+//
+// built and run with 'make bench' from the src directory, 'make debug=no
+// bench' gives optimized numbers
+
+#include "bench.hh"
+#include "../diff.hh"
+#include "../string_utils.hh"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace Kakoune;
+using namespace Kakoune::Bench;
+
+namespace
+{
+
+struct Texts
+{
+    String before;
+    String after;
+};
+
+// lines of before are changed every change_interval line in after
+Texts make_texts(int line_count, int change_interval)
+{
+    Texts texts;
+    for (int i = 0; i < line_count; ++i)
+    {
+        String line = format("    auto value_{} = compute(context, {});\n", i, i % 97);
+        texts.before += line;
+        texts.after += i % change_interval == 0 ? format("    // changed line {}\n", i) : line;
+    }
+    return texts;
+}
+
+Vector<StringView> split_lines(StringView text)
+{
+    Vector<StringView> lines;
+    for (auto it = text.begin(), end = text.end(); it != end; )
+    {
+        auto eol = std::find(it, end, '\n') + 1;
+        lines.emplace_back(it, eol);
+        it = eol;
+    }
+    return lines;
+}
+
+}
+
+int main()
+{
+    printf("linewise diffs of 1M lines, in ms\n\n");
+    printf("  %-22s%12s%12s\n", "", "find_diff", "hashed");
+    for (int interval : {10000, 100, 7})
+    {
+        const auto texts = make_texts(1000000, interval);
+        const auto lines_before = split_lines(texts.before);
+        const auto lines_after = split_lines(texts.after);
+        const double myers = measure([&] {
+            sink = find_diff(lines_before.begin(), (int)lines_before.size(),
+                             lines_after.begin(), (int)lines_after.size()).size();
+        }, 1);
+        const double hashed = measure([&] {
+            sink = find_diff_hashed(lines_before.begin(), (int)lines_before.size(),
+                                    lines_after.begin(), (int)lines_after.size()).size();
+        }, 1);
+        printf("  1 change in %-9d%12.1f%12.1f\n", interval, myers, hashed);
+    }
+
+    printf("\ntext diffs of 20k lines, in ms\n\n");
+    printf("  %-22s%12s%12s\n", "", "bytewise", "text diff");
+    for (int interval : {50, 2})
+    {
+        const auto texts = make_texts(20000, interval);
+        const double bytewise = measure([&] {
+            sink = find_diff(texts.before.begin(), (int)texts.before.length(),
+                             texts.after.begin(), (int)texts.after.length()).size();
+        }, 1);
+        const double text = measure([&] {
+            sink = find_text_diff(texts.before, texts.after).size();
+        }, 1);
+        printf("  1 change in %-9d%12.1f%12.1f\n", interval, bytewise, text);
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Compares keyword highlighter regexes, as rc/ scripts build them from
+// their word lists, compiled to a trie to the same alternations written so
+// that they are not, on the concatenated sources of the current directory,
+// with more and more of the words of each list.
+//
+// built and run with 'make bench' from the src directory, 'make debug=no
+// bench' gives optimized numbers
+
+#include "bench.hh"
+#include "../regex_impl.hh"
+#include "../string_utils.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <glob.h>
+
+using namespace Kakoune;
+using namespace Kakoune::Bench;
+
+namespace
+{
+
+String read_file(const char* path)
+{
+    std::ifstream file{path};
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str().c_str();
+}
+
+String read_sources()
+{
+    String sources;
+    glob_t files;
+    if (glob("*.cc", 0, nullptr, &files) == 0)
+    {
+        for (size_t i = 0; i < files.gl_pathc; ++i)
+            sources += read_file(files.gl_pathv[i]);
+    }
+    globfree(&files);
+    return sources;
+}
+
+// Words of the shell variable assignments 'name="..."' of a script that
+// contain the given word, including those appended with name="${name}|..."
+Vector<String> read_words(const char* path, StringView name, StringView word)
+{
+    const String script = read_file(path);
+    const String assignment = name + "=\"";
+    const String append = "${" + name + "}";
+    Vector<String> words;
+    bool found = false;
+    for (auto it = script.begin(), end = script.end(); ; )
+    {
+        it = std::search(it, end, assignment.begin(), assignment.end());
+        if (it == end)
+            break;
+        it += (int)assignment.length();
+        auto value_end = std::find(it, end, '"');
+        StringView value{it, value_end};
+        it = value_end;
+        if (value.substr(0, append.length()) != append)
+        {
+            if (found)
+                break;
+            words.clear();
+        }
+        for (auto& w : split(value, ' '))
+            for (auto& v : split(w, '|'))
+                for (auto& part : split(v, '\n'))
+                {
+                    if (not part.empty() and part != append)
+                        words.push_back(part.str());
+                }
+        found = found or contains(words, word);
+    }
+    if (not found)
+        words.clear();
+    return words;
+}
+
+size_t count_matches(const CompiledRegex& program, StringView subject)
+{
+    ThreadedRegexVM<const char*, MatchDirection::Forward> vm{program};
+    size_t count = 0;
+    for (auto pos = subject.begin(), end = subject.end(); ; ++count)
+    {
+        auto flags = RegexExecFlags::Search | RegexExecFlags::NotInitialNull;
+        if (pos != subject.begin())
+            flags |= RegexExecFlags::PrevAvailable;
+        if (not vm.exec(pos, end, flags))
+            return count;
+        pos = vm.captures()[1];
+    }
+}
+
+}
+
+int main()
+{
+    const String sources = read_sources();
+    if (sources.empty())
+    {
+        fprintf(stderr, "no sources found, run from the src directory\n");
+        return 1;
+    }
+
+    struct WordList { const char* name; Vector<String> words; };
+    const WordList lists[] = {
+        { "cpp keywords", read_words("../rc/core/c-family.kak", "keywords", "alignas") },
+        { "cpp types", read_words("../rc/core/c-family.kak", "types", "char16_t") },
+        { "cpp attributes", read_words("../rc/core/c-family.kak", "attributes", "constexpr") },
+    };
+
+    printf("all the matches of \\b(word|...)\\b on %d KiB of sources, in ms\n\n",
+           (int)sources.length() >> 10);
+    printf("  %-18s%8s%10s%12s%12s\n", "", "words", "matches", "plain", "trie");
+    for (auto& list : lists)
+    {
+        if (list.words.empty())
+        {
+            fprintf(stderr, "%s not found, run from the src directory\n", list.name);
+            return 1;
+        }
+        const int word_count = (int)list.words.size();
+        for (int count : {8, 32, word_count})
+        {
+            if (count > word_count)
+                continue;
+            // a group in front of each alternative keeps them from being merged
+            String trie_re, plain_re;
+            for (int i = 0; i < count; ++i)
+            {
+                StringView word = list.words[i];
+                trie_re += format("{}{}", i == 0 ? "" : "|", word);
+                plain_re += format("{}(?:{}){}", i == 0 ? "" : "|", word.substr(0, 1_byte), word.substr(1_byte));
+            }
+            auto trie = compile_regex(format("\\b({})\\b", trie_re), RegexCompileFlags::None);
+            auto plain = compile_regex(format("\\b({})\\b", plain_re), RegexCompileFlags::None);
+            kak_assert(not trie.literal_switches.empty() and plain.literal_switches.empty());
+
+            size_t matches = 0;
+            const double plain_time = measure([&] { sink = matches = count_matches(plain, sources); }, 1);
+            const double trie_time = measure([&] { sink = count_matches(trie, sources); }, 1);
+            printf("  %-18s%8d%10zu%12.1f%12.1f\n", list.name, count, matches, plain_time, trie_time);
+            if (count == word_count)
+                break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Compares LineList to a flat vector of lines, as buffers used to store
+// them, on two line insertions and erasures near the start of large
+// buffers, and on reading every line in order.
+//
+// built and run with 'make bench' from the src directory, 'make debug=no
+// bench' gives optimized numbers
+
+#include "bench.hh"
+#include "../line_list.hh"
+#include "../string_utils.hh"
+
+#include <cstdio>
+
+using namespace Kakoune;
+using namespace Kakoune::Bench;
+
+namespace
+{
+
+constexpr int edit_count = 200;
+
+BufferLines make_lines(int count)
+{
+    BufferLines lines;
+    lines.reserve(count);
+    for (int i = 0; i < count; ++i)
+        lines.push_back(StringData::create({format("line {} of a large buffer\n", i)}));
+    return lines;
+}
+
+}
+
+int main()
+{
+    printf("edits: %d insertions and erasures of two lines at line 10, in us per edit\n"
+           "reads: every line in order, in ns per line\n\n", edit_count);
+    printf("  %-10s%14s%14s%14s%14s\n", "lines", "vector edit", "list edit", "vector read", "list read");
+
+    const BufferLines inserted = make_lines(2);
+    for (int count : {1000000, 4000000})
+    {
+        BufferLines vector = make_lines(count);
+        LineList list{vector};
+
+        const double vector_edit = measure([&] {
+            for (int i = 0; i < edit_count; ++i)
+            {
+                vector.insert(vector.begin() + 10, inserted.begin(), inserted.end());
+                vector.erase(vector.begin() + 10, vector.begin() + 12);
+            }
+        }) * 1000 / edit_count;
+
+        const double list_edit = measure([&] {
+            for (int i = 0; i < edit_count; ++i)
+            {
+                BufferLines lines = inserted;
+                list.insert(10_line, lines.begin(), lines.end());
+                list.erase(10_line, 12_line);
+            }
+        }) * 1000 / edit_count;
+
+        const double vector_read = measure([&] {
+            size_t bytes = 0;
+            for (auto& line : vector)
+                bytes += line->length;
+            sink = bytes;
+        }) * 1000000 / count;
+
+        // by line index, as buffer iterators do
+        const double list_read = measure([&] {
+            size_t bytes = 0;
+            for (int line = 0; line < count; ++line)
+                bytes += (int)list[LineCount{line}].length();
+            sink = bytes;
+        }) * 1000000 / count;
+
+        printf("  %-10d%14.2f%14.2f%14.2f%14.2f\n", count, vector_edit, list_edit, vector_read, list_read);
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Compares searching regexes that only match a literal string with the
+// literal matcher to running their program, with and without skipping to
+// their required literal, on a generated log: a single search for a line
+// at its end, and all the matches of a frequent word as 's' selects them.
+//
+// built and run with 'make bench' from the src directory, 'make debug=no
+// bench' gives optimized numbers
+
+#include "bench.hh"
+#include "../regex_impl.hh"
+#include "../string_utils.hh"
+
+#include <cstdio>
+
+using namespace Kakoune;
+using namespace Kakoune::Bench;
+
+namespace
+{
+
+String make_log()
+{
+    String log;
+    for (int i = 0; i < 1000000; ++i)
+        log += format("2024-03-{} 12:{}:{} INFO worker {} processed request {} in {}ms\n",
+                      10 + i % 20, 10 + i % 50, 10 + i % 49, i % 16, i, i % 300);
+    log += "2024-03-30 12:59:59 ERROR worker 7 failed: timeout\n";
+    return log;
+}
+
+size_t count_matches(const CompiledRegex& program, StringView subject)
+{
+    ThreadedRegexVM<const char*, MatchDirection::Forward> vm{program};
+    size_t count = 0;
+    for (auto pos = subject.begin(), end = subject.end(); ; ++count)
+    {
+        auto flags = RegexExecFlags::Search | RegexExecFlags::NotInitialNull;
+        if (pos != subject.begin())
+            flags |= RegexExecFlags::PrevAvailable;
+        if (not vm.exec(pos, end, flags))
+            return count;
+        pos = vm.captures()[1];
+    }
+}
+
+}
+
+int main()
+{
+    const String log = make_log();
+    printf("in ms on a %d MiB log, program: without literal optimizations,\n"
+           "required: skipping to the required literal, literal: literal matcher\n\n",
+           (int)log.length() >> 20);
+    printf("  %-26s%-8s%12s%12s%12s\n", "", "", "program", "required", "literal");
+
+    const std::pair<StringView, bool> searches[] = {
+        { "ERROR worker", false },
+        { "(?i)error worker", false },
+        { R"(\bERROR\b)", false },
+        { "worker 7 ", true },
+        { R"((?i)\bworker\b)", true },
+    };
+    for (auto& search : searches)
+    {
+        auto literal = compile_regex(search.first, RegexCompileFlags::None);
+        if (not literal.literal_pattern)
+        {
+            fprintf(stderr, "%s is not compiled to a literal pattern\n", search.first.str().c_str());
+            return 1;
+        }
+        auto required = compile_regex(search.first, RegexCompileFlags::None);
+        required.literal_pattern.reset();
+        auto program = compile_regex(search.first, RegexCompileFlags::None);
+        program.literal_pattern.reset();
+        program.required_literal.reset();
+
+        auto time = [&](const CompiledRegex& regex) {
+            return measure([&] {
+                if (search.second)
+                    sink = count_matches(regex, log);
+                else
+                {
+                    ThreadedRegexVM<const char*, MatchDirection::Forward> vm{regex};
+                    sink = vm.exec(log.begin(), log.end(), RegexExecFlags::Search);
+                }
+            }, 3);
+        };
+        printf("  %-26s%-8s%12.1f%12.1f%12.1f\n", search.first.str().c_str(),
+               search.second ? "all" : "last", time(program), time(required), time(literal));
+    }
+    return 0;
+}
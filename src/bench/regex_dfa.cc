@@ -0,0 +1,82 @@
+// Compares the lazy DFA to the VM on the executions it answers: existence
+// searches, as keep filters selections, on a long generated line they do
+// not match, and full matches, as hooks filter their parameters, on many
+// file names. The VM runs alone when given back a DFA that disables itself.
+//
+// built and run with 'make bench' from the src directory, 'make debug=no
+// bench' gives optimized numbers
+
+#include "bench.hh"
+#include "../regex_impl.hh"
+#include "../string_utils.hh"
+
+#include <cstdio>
+
+using namespace Kakoune;
+using namespace Kakoune::Bench;
+
+namespace
+{
+
+String make_line()
+{
+    String line;
+    for (int i = 0; i < 100000; ++i)
+        line += "{" + format("\"id\":{},\"name\":\"item_{}\",\"tags\":[\"a{}\",\"b\"]", i, i % 977, i % 13) + "},";
+    return line;
+}
+
+Vector<String> make_file_names()
+{
+    const StringView extensions[] = { "cc", "hh", "txt", "md", "json", "py", "kak" };
+    Vector<String> names;
+    for (int i = 0; i < 100000; ++i)
+        names.push_back(format("src/module_{}/file_{}.{}", i % 37, i, extensions[i % 7]));
+    return names;
+}
+
+template<typename Func>
+void compare(StringView regex, StringView subject_name, Func exec)
+{
+    auto with_dfa = compile_regex(regex, RegexCompileFlags::None);
+    auto without_dfa = compile_regex(regex, RegexCompileFlags::None);
+    without_dfa.required_literal.reset();
+    with_dfa.required_literal.reset();
+    without_dfa.give_back_dfa(std::make_unique<RegexDFA>(without_dfa, 0));
+
+    const double vm = measure([&] { sink = exec(without_dfa); });
+    const double dfa = measure([&] { sink = exec(with_dfa); });
+    printf("  %-34s%-12s%12.1f%12.1f\n", regex.str().c_str(), subject_name.str().c_str(), vm, dfa);
+}
+
+}
+
+int main()
+{
+    const String line = make_line();
+    const Vector<String> file_names = make_file_names();
+    printf("in ms, line: %d KiB, names: %d file names\n"
+           "required literals are not skipped to, to compare the engines alone\n\n",
+           (int)line.length() >> 10, (int)file_names.size());
+    printf("  %-34s%-12s%12s%12s\n", "", "", "vm", "dfa");
+
+    auto search = [&](const CompiledRegex& program) {
+        ThreadedRegexVM<const char*, MatchDirection::Forward> vm{program};
+        return vm.exec(line.begin(), line.end(), RegexExecFlags::Search |
+                       RegexExecFlags::AnyMatch | RegexExecFlags::NoSaves);
+    };
+    compare(R"("name":"item_\d{4}")", "line", search);
+    compare(R"("tags":\["[a-z]\d+","c")", "line", search);
+    compare(R"(\w+_\d+"\]\})", "line", search);
+
+    auto match_all = [&](const CompiledRegex& program) {
+        ThreadedRegexVM<const char*, MatchDirection::Forward> vm{program};
+        size_t count = 0;
+        for (auto& name : file_names)
+            count += vm.exec(name.begin(), name.end(), RegexExecFlags::AnyMatch | RegexExecFlags::NoSaves);
+        return count;
+    };
+    compare(R"(.*\.(cc|hh))", "names", match_all);
+    compare(R"(src/\w+/[^/]*_1\d*\.\w+)", "names", match_all);
+    return 0;
+}
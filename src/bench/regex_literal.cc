@@ -0,0 +1,92 @@
+// Times single regex searches with and without skipping to the literal
+// every match requires, on the concatenated sources of the current
+// directory and on a generated log whose only error is on its last line.
+//
+// built and run with 'make bench' from the src directory, 'make debug=no
+// bench' gives optimized numbers
+
+#include "bench.hh"
+#include "../regex_impl.hh"
+#include "../string_utils.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <glob.h>
+
+using namespace Kakoune;
+using namespace Kakoune::Bench;
+
+namespace
+{
+
+String read_sources()
+{
+    String sources;
+    glob_t files;
+    if (glob("*.cc", 0, nullptr, &files) == 0)
+    {
+        for (size_t i = 0; i < files.gl_pathc; ++i)
+        {
+            std::ifstream file{files.gl_pathv[i]};
+            std::stringstream content;
+            content << file.rdbuf();
+            sources += content.str().c_str();
+        }
+    }
+    globfree(&files);
+    return sources;
+}
+
+String make_log()
+{
+    String log;
+    for (int i = 0; i < 250000; ++i)
+        log += format("2024-03-{} 12:{}:{} INFO worker {} processed request {} in {}ms\n",
+                      10 + i % 20, 10 + i % 50, 10 + i % 49, i % 16, i, i % 300);
+    log += "2024-03-30 12:59:59 ERROR worker 7 failed: timeout\n";
+    return log;
+}
+
+double search_time(const CompiledRegex& program, StringView subject)
+{
+    return measure([&] {
+        ThreadedRegexVM<const char*, MatchDirection::Forward> vm{program};
+        sink = vm.exec(subject.begin(), subject.end(), RegexExecFlags::Search);
+    });
+}
+
+}
+
+int main()
+{
+    const String sources = read_sources();
+    if (sources.empty())
+    {
+        fprintf(stderr, "no sources found, run from the src directory\n");
+        return 1;
+    }
+    const String log = make_log();
+
+    printf("single searches, in ms, sources: %d KiB, log: %d KiB\n\n",
+           (int)sources.length() >> 10, (int)log.length() >> 10);
+    printf("  %-22s%-9s%12s%12s\n", "", "", "program", "literal");
+
+    const std::pair<StringView, const String*> searches[] = {
+        { R"(\w+_not_there\()", &sources },
+        { R"(ERROR worker \d+)", &log },
+        { R"(\d+ failed: \w+)", &log },
+    };
+    for (auto& search : searches)
+    {
+        auto with_literal = compile_regex(search.first, RegexCompileFlags::None);
+        auto without_literal = compile_regex(search.first, RegexCompileFlags::None);
+        without_literal.required_literal.reset();
+        printf("  %-22s%-9s%12.1f%12.1f\n", search.first.str().c_str(),
+               search.second == &sources ? "sources" : "log",
+               search_time(without_literal, *search.second),
+               search_time(with_literal, *search.second));
+    }
+    return 0;
+}
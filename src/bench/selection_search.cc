@@ -0,0 +1,89 @@
+// Times searching selections for regex matches on more and more threads,
+// as the regex_threads option allows: 's' and 'S' on a whole generated
+// buffer, and '<a-k>' on each of its lines.
+//
+// built and run with 'make bench' from the src directory, 'make debug=no
+// bench' gives optimized numbers
+
+#include "bench.hh"
+#include "../buffer.hh"
+#include "../option_types.hh"
+#include "../regex.hh"
+#include "../scope.hh"
+#include "../selectors.hh"
+#include "../string_utils.hh"
+
+#include <cstdio>
+#include <thread>
+
+using namespace Kakoune;
+using namespace Kakoune::Bench;
+
+namespace
+{
+
+// the options buffers read, as main.cc declares them
+void declare_buffer_options(OptionsRegistry& reg)
+{
+    reg.declare_option("eolformat", "", EolFormat::Lf);
+    reg.declare_option("BOM", "", ByteOrderMark::None);
+    reg.declare_option("history_memory_limit", "", 0);
+    reg.declare_option("undo_journal_dir", "", ""_str);
+}
+
+String make_content()
+{
+    String content;
+    for (int i = 0; i < 400000; ++i)
+        content += format("{} worker {} {} request {} in {}ms\n", 10 + i % 50,
+                          i % 16, i % 1000 == 0 ? "failed" : "processed", i, i % 300);
+    return content;
+}
+
+}
+
+int main()
+{
+    GlobalScope global_scope;
+    declare_buffer_options(global_scope.option_registry());
+    const String content = make_content();
+    Buffer buffer{"bench", Buffer::Flags::None, content};
+
+    const SelectionList whole{buffer, {{0, 0}, buffer.back_coord()}};
+    Vector<Selection> line_selections;
+    for (LineCount line = 0; line < buffer.line_count(); ++line)
+        line_selections.emplace_back(BufferCoord{line, 0}, BufferCoord{line, buffer[line].length() - 1});
+    const SelectionList lines{buffer, std::move(line_selections)};
+
+    printf("in ms on %d lines, %d KiB, %u hardware threads\n\n", (int)buffer.line_count(),
+           (int)content.length() >> 10, std::thread::hardware_concurrency());
+    printf("  %-8s%-22s%10s%10s%10s%10s\n", "", "", "1", "2", "4", "8");
+
+    auto run = [&](const char* name, StringView re, auto func) {
+        Regex regex{re};
+        printf("  %-8s%-22s", name, re.str().c_str());
+        for (int thread_count : {1, 2, 4, 8})
+            printf("%10.1f", measure([&] { sink = func(regex, thread_count); }, 3));
+        printf("\n");
+    };
+
+    auto select = [&](const Regex& regex, int thread_count) {
+        SelectionList selections = whole;
+        select_all_matches(selections, regex, 0, thread_count);
+        return selections.size();
+    };
+    run("s", R"(failed)", select);
+    run("s", R"(request \d+)", select);
+    run("s", R"(\w+ in \d+ms)", select);
+
+    run("S", R"(\n)", [&](const Regex& regex, int thread_count) {
+        SelectionList selections = whole;
+        split_selections(selections, regex, 0, thread_count);
+        return selections.size();
+    });
+
+    run("<a-k>", R"(worker 7 failed)", [&](const Regex& regex, int thread_count) {
+        return keep_matching(lines, regex, true, thread_count).size();
+    });
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Compares SlabAllocator to malloc on many objects of buffer line sizes:
+// allocation and deallocation times, and resident memory once allocated
+// and once freed. Each allocator runs in its own process, so that the
+// memory kept by one does not show in the other.
+//
+// built and run with 'make bench' from the src directory, 'make debug=no
+// bench' gives optimized numbers
+
+#include "../slab_allocator.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace Kakoune;
+
+namespace
+{
+
+constexpr size_t object_count = 10000000;
+
+size_t resident_mib()
+{
+    size_t size = 0, resident = 0;
+    if (FILE* statm = fopen("/proc/self/statm", "r"))
+    {
+        if (fscanf(statm, "%zu %zu", &size, &resident) != 2)
+            resident = 0;
+        fclose(statm);
+    }
+    return resident * sysconf(_SC_PAGESIZE) >> 20;
+}
+
+template<typename Alloc, typename Dealloc>
+void run(const char* name, Alloc alloc, Dealloc dealloc)
+{
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
+
+    std::vector<std::pair<void*, size_t>> objects;
+    objects.reserve(object_count);
+    const size_t initial = resident_mib();
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < object_count; ++i)
+    {
+        const size_t size = 29 + (i * 7919) % 40;
+        void* ptr = alloc(size);
+        memset(ptr, 'a', size);
+        objects.emplace_back(ptr, size);
+    }
+    const double alloc_time = ms(start);
+    const size_t allocated = resident_mib() - initial;
+
+    start = Clock::now();
+    for (auto& object : objects)
+        dealloc(object.first, object.second);
+    const double dealloc_time = ms(start);
+    const size_t freed = resident_mib() - initial;
+
+    printf("  %-8s%12.1f%12.1f%12zu%12zu\n", name, alloc_time, dealloc_time, allocated, freed);
+}
+
+template<typename Func>
+void in_child(Func func)
+{
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        func();
+        fflush(stdout);
+        _exit(0);
+    }
+    waitpid(pid, nullptr, 0);
+}
+
+}
+
+int main()
+{
+    printf("%zuM objects of 29 to 68 bytes, times in ms, resident memory in MiB\n"
+           "including the %zu MiB list of objects\n\n", object_count / 1000000,
+           object_count * sizeof(std::pair<void*, size_t>) >> 20);
+    printf("  %-8s%12s%12s%12s%12s\n", "", "alloc", "free", "allocated", "freed");
+
+    in_child([] {
+        run("malloc", [](size_t size) { return malloc(size); },
+                      [](void* ptr, size_t) { free(ptr); });
+    });
+    in_child([] {
+        SlabAllocator allocator{MemoryDomain::Undefined};
+        run("slabs", [&](size_t size) { return allocator.allocate(size); },
+                     [&](void* ptr, size_t size) { allocator.deallocate(ptr, size); });
+    });
+    return 0;
+}
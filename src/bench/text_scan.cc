@@ -0,0 +1,150 @@
+// Times the text_scan kernels at each supported level against plain byte loops,
+// on 64MiB of mixed ascii and utf8 text with crlf line endings. The ascii end
+// is searched in the same text without its non ascii bytes.
+//
+// built and run with 'make bench' from the src directory
+
+#include "bench.hh"
+#include "../text_scan.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Kakoune;
+using namespace Kakoune::Bench;
+
+namespace
+{
+
+constexpr size_t data_size = 64 * 1024 * 1024;
+constexpr int runs = 5;
+
+std::string make_data()
+{
+    const char* words[] = { "buffer", "selection", "kakoune", "x", "éléphant",
+                            "données", "日本語", "λόγος", "{", "}", "    " };
+    std::mt19937 rng{42};
+    std::string data;
+    data.reserve(data_size + 64);
+    while (data.size() < data_size)
+    {
+        const int word_count = rng() % 16;
+        for (int i = 0; i < word_count; ++i)
+        {
+            data += words[rng() % (sizeof(words) / sizeof(words[0]))];
+            data += ' ';
+        }
+        data += "\r\n";
+    }
+    return data;
+}
+
+void print_row(const char* name, double baseline, const std::vector<double>& levels)
+{
+    printf("  %-18s%10.1f", name, baseline);
+    for (auto time : levels)
+        printf("%8.1f", time);
+    printf("\n");
+}
+
+}
+
+int main()
+{
+    const std::string data = make_data();
+    const char* begin = data.data();
+    const char* end = begin + data.size();
+    std::string ascii;
+    for (char c : data)
+    {
+        if ((unsigned char)c < 0x80)
+            ascii += c;
+    }
+    const char* ascii_begin = ascii.data();
+    const char* ascii_end = ascii_begin + ascii.size();
+    std::string copy;
+
+    std::vector<ScanLevel> levels{ScanLevel::Scalar};
+    const char* level_names[] = { "scalar", "sse2", "avx2" };
+    for (auto level : {ScanLevel::Sse2, ScanLevel::Avx2})
+    {
+        if (level <= supported_scan_level())
+            levels.push_back(level);
+    }
+
+    auto run_levels = [&](auto func) {
+        std::vector<double> res;
+        for (auto level : levels)
+        {
+            set_scan_level(level);
+            res.push_back(measure(func));
+        }
+        return res;
+    };
+
+    printf("%zu MiB, mean of %d runs, in ms\n\n", data.size() >> 20, runs);
+    printf("  %-18s%10s", "", "byte loop");
+    for (auto level : levels)
+        printf("%8s", level_names[(int)level]);
+    printf("\n");
+
+    print_row("count '\\n'", measure([&] {
+        size_t count = 0;
+        for (const char* it = begin; it != end; ++it)
+            count += *it == '\n';
+        sink = count;
+    }), run_levels([&] { sink = count_byte(begin, end, '\n'); }));
+
+    print_row("count codepoints", measure([&] {
+        size_t count = 0;
+        for (const char* it = begin; it != end; ++it)
+            count += ((unsigned char)*it & 0xC0) != 0x80;
+        sink = count;
+    }), run_levels([&] { sink = count_codepoints(begin, end); }));
+
+    print_row("find ascii end", measure([&] {
+        const char* it = ascii_begin;
+        while (it != ascii_end and (unsigned char)*it < 0x80)
+            ++it;
+        sink = it - ascii_begin;
+    }), run_levels([&] { sink = find_non_ascii(ascii_begin, ascii_end) - ascii_begin; }));
+
+    print_row("find each '\\n'", measure([&] {
+        size_t count = 0;
+        for (const char* it = begin; it != end; ++it)
+        {
+            auto* next = static_cast<const char*>(memchr(it, '\n', end - it));
+            if (not next)
+                break;
+            it = next;
+            ++count;
+        }
+        sink = count;
+    }), run_levels([&] {
+        size_t count = 0;
+        for (const char* it = begin; (it = find_byte(it, end, '\n')) != end; ++it)
+            ++count;
+        sink = count;
+    }));
+
+    print_row("remove '\\r'", measure([&] {
+        copy.assign(begin, end);
+        char* out = &copy[0];
+        for (const char* it = copy.data(), *copy_end = it + copy.size(); it != copy_end; ++it)
+        {
+            if (*it != '\r')
+                *out++ = *it;
+        }
+        sink = out - copy.data();
+    }), run_levels([&] {
+        copy.assign(begin, end);
+        sink = remove_byte(copy.data(), copy.data() + copy.size(), &copy[0], '\r') - copy.data();
+    }));
+
+    printf("\n  byte loop for find each '\\n' is memchr\n");
+    set_scan_level(supported_scan_level());
+    return 0;
+}
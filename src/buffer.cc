@@ -2,20 +2,29 @@
 
 #include "assert.hh"
 #include "buffer_manager.hh"
+#include "buffer_snapshot.hh"
 #include "buffer_utils.hh"
 #include "client.hh"
 #include "context.hh"
 #include "diff.hh"
+#include "event_manager.hh"
 #include "file.hh"
 #include "flags.hh"
+#include "hash_map.hh"
 #include "option_types.hh"
 #include "ranges.hh"
+#include "regex_impl.hh"
 #include "shared_string.hh"
+#include "text_scan.hh"
 #include "unit_tests.hh"
 #include "utils.hh"
 #include "window.hh"
 
 #include <algorithm>
+#include <system_error>
+#include <thread>
+
+#include <cstring>
 
 namespace Kakoune
 {
@@ -27,32 +36,111 @@ struct ParsedLines
     EolFormat eolformat = EolFormat::Lf;
 };
 
-static ParsedLines parse_lines(StringView data)
+// Splits data in ranges of complete lines that can be processed in parallel
+static Vector<StringView> split_in_ranges(StringView data)
+{
+    constexpr int min_range_size = 1024 * 1024;
+    const int max_count = (int)Kakoune::clamp(std::thread::hardware_concurrency(), 1u, 16u);
+    const int count = Kakoune::clamp((int)data.length() / min_range_size, 1, max_count);
+
+    Vector<StringView> ranges;
+    const char* begin = data.begin();
+    for (int i = 1; i <= count and begin != data.end(); ++i)
+    {
+        const char* end = data.begin() + (int)((size_t)(int)data.length() * i / count);
+        if (end < begin)
+            continue;
+        end = find_byte(end, data.end(), '\n');
+        if (end != data.end())
+            ++end;
+        ranges.emplace_back(begin, end);
+        begin = end;
+    }
+    return ranges;
+}
+
+// Calls func(index, range) for each range, using a thread per range
+template<typename Func>
+static void for_each_range(ConstArrayView<StringView> ranges, Func func)
+{
+    Vector<WorkerAllocations> allocations(ranges.size());
+    Vector<std::thread> threads;
+    for (int i = 1; i < ranges.size(); ++i)
+    {
+        try
+        {
+            threads.emplace_back([&, i] {
+                allocations[i].count_on_this_thread();
+                func(i, ranges[i]);
+            });
+        }
+        catch (std::system_error&)
+        {
+            func(i, ranges[i]);
+        }
+    }
+    if (not ranges.empty())
+        func(0, ranges[0]);
+    for (auto& thread : threads)
+        thread.join();
+}
+
+// Detects the byte order mark and eol format, and removes the bom from data
+static ParsedLines parse_format(StringView& data)
 {
     ParsedLines res;
-    const char* pos = data.begin();
     if (data.substr(0, 3_byte) == "\xEF\xBB\xBF")
     {
         res.bom = ByteOrderMark::Utf8;
-        pos = data.begin() + 3;
+        data = data.substr(3_byte);
     }
 
-    bool has_crlf = false, has_lf = false;
-    for (auto it = pos; it != data.end(); ++it)
-    {
-        if (*it == '\n')
-            ((it != pos and *(it-1) == '\r') ? has_crlf : has_lf) = true;
-    }
+    const auto ranges = split_in_ranges(data);
+    Vector<std::pair<bool, bool>> has_crlf_lf(ranges.size(), {false, false});
+    for_each_range(ranges, [&, data](int index, StringView range) {
+        bool has_crlf = false, has_lf = false;
+        for (auto it = find_byte(range.begin(), range.end(), '\n'); it != range.end();
+             it = find_byte(it+1, range.end(), '\n'))
+            ((it != data.begin() and *(it-1) == '\r') ? has_crlf : has_lf) = true;
+        has_crlf_lf[index] = {has_crlf, has_lf};
+    });
+
+    const bool has_crlf = contains_that(has_crlf_lf, [](auto& p) { return p.first; });
+    const bool has_lf = contains_that(has_crlf_lf, [](auto& p) { return p.second; });
     const bool crlf = has_crlf and not has_lf;
     res.eolformat = crlf ? EolFormat::Crlf : EolFormat::Lf;
+    return res;
+}
 
-    while (pos < data.end())
-    {
-        const char* eol = std::find(pos, data.end(), '\n');
-        res.lines.emplace_back(StringData::create({{pos, eol - (crlf and eol != data.end() ? 1 : 0)}, "\n"}));
-        pos = eol + 1;
-    }
+static void split_lines(ParsedLines& res, StringView data)
+{
+    const bool crlf = res.eolformat == EolFormat::Crlf;
+    const auto ranges = split_in_ranges(data);
+    Vector<BufferLines> range_lines(ranges.size());
+    for_each_range(ranges, [&](int index, StringView range) {
+        auto& lines = range_lines[index];
+        lines.reserve(count_byte(range.begin(), range.end(), '\n') + 1);
+        const char* pos = range.begin();
+        while (pos < range.end())
+        {
+            const char* eol = find_byte(pos, range.end(), '\n');
+            lines.emplace_back(StringData::create({{pos, eol - (crlf and eol != range.end() ? 1 : 0)}, "\n"}));
+            pos = eol + 1;
+        }
+    });
+
+    size_t count = 0;
+    for (auto& lines : range_lines)
+        count += lines.size();
+    res.lines.reserve(res.lines.size() + count);
+    for (auto& lines : range_lines)
+        std::move(lines.begin(), lines.end(), std::back_inserter(res.lines));
+}
 
+static ParsedLines parse_lines(StringView data)
+{
+    ParsedLines res = parse_format(data);
+    split_lines(res, data);
     return res;
 }
 
@@ -67,7 +155,7 @@ Buffer::HistoryNode::HistoryNode(size_t id, HistoryNode* parent)
 {}
 
 Buffer::Buffer(String name, Flags flags, StringView data,
-               timespec fs_timestamp)
+               timespec fs_timestamp, RefPtr<MappedFile> mapping)
     : Scope{GlobalScope::instance()},
       m_name{(flags & Flags::File) ? real_path(parse_filename(name)) : std::move(name)},
       m_display_name{(flags & Flags::File) ? compact_path(m_name) : m_name},
@@ -76,17 +164,58 @@ Buffer::Buffer(String name, Flags flags, StringView data,
       m_last_save_history_cursor{&m_history},
       m_fs_timestamp{fs_timestamp.tv_sec, fs_timestamp.tv_nsec}
 {
-    ParsedLines parsed_lines = parse_lines(data);
+    ParsedLines parsed_lines = parse_format(data);
+
+    // Large files are not copied upfront if we can make sure we will be
+    // notified before their content changes under us.
+    constexpr ByteCount lazy_load_min_size = 1024 * 1024;
+    if (mapping and data.length() >= lazy_load_min_size and
+        parsed_lines.eolformat == EolFormat::Lf and
+        mapping->watch_modifications([this] {
+            // A search can be reading the mapping, copy the lines once it returned
+            if (RegexInterrupt::current())
+            {
+                m_materialize_timer = std::make_unique<Timer>(Clock::now(), [this](Timer&) {
+                    m_lines.materialize();
+                });
+                return false;
+            }
+            // Otherwise copy them right away, shell commands are waited on with
+            // urgent event handling only and may be the ones writing the file.
+            // The mapping itself is released after this callback returned.
+            auto mapping = m_lines.materialize();
+            const bool shared = mapping->refcount > 1;
+            m_materialize_timer = std::make_unique<Timer>(Clock::now(),
+                [mapping = std::move(mapping)](Timer&) mutable { mapping.reset(); });
+            return not shared;
+        }))
+    {
+        auto end = data.end();
+        while (end != data.begin() and *(end-1) != '\n')
+            --end;
+        m_lines.assign_mapped({data.begin(), end}, std::move(mapping));
+        if (end != data.end())
+        {
+            BufferLines last_line{StringData::create({{end, data.end()}, "\n"})};
+            m_lines.insert(line_count(), last_line.begin(), last_line.end());
+        }
+    }
+    else
+    {
+        split_lines(parsed_lines, data);
+        m_lines.assign(std::move(parsed_lines.lines));
+    }
 
-    if (parsed_lines.lines.empty())
-        parsed_lines.lines.emplace_back(StringData::create({"\n"}));
+    if (m_lines.empty())
+    {
+        BufferLines empty_line{StringData::create({"\n"})};
+        m_lines.insert(0_line, empty_line.begin(), empty_line.end());
+    }
 
     #ifdef KAK_DEBUG
-    for (auto& line : parsed_lines.lines)
-        kak_assert(not (line->length == 0) and
-                   line->data()[line->length-1] == '\n');
+    for (auto line : m_lines)
+        kak_assert(not line.empty() and line.back() == '\n');
     #endif
-    static_cast<BufferLines&>(m_lines) = std::move(parsed_lines.lines);
 
     m_changes.push_back({ Change::Insert, {0,0}, line_count() });
 
@@ -118,6 +247,7 @@ void Buffer::on_registered()
             kak_assert(m_fs_timestamp != InvalidTime);
             run_hook_in_own_context("BufOpenFile", m_name);
         }
+        open_history_journal();
     }
 
     for (auto& option : options().flatten_options())
@@ -196,6 +326,11 @@ BufferCoordAndTarget Buffer::offset_coord(BufferCoordAndTarget coord, LineCount
     return {line, get_byte_to_column(*this, tabstop, {line, final_column}), column};
 }
 
+BufferSnapshot Buffer::snapshot() const
+{
+    return {m_lines, timestamp()};
+}
+
 String Buffer::string(BufferCoord begin, BufferCoord end) const
 {
     String res;
@@ -242,49 +377,47 @@ void Buffer::reload(StringView data, timespec fs_timestamp)
     if (not record_undo)
     {
         // Erase history about to be invalidated history
-        m_history_cursor = &m_history;
-        m_last_save_history_cursor = &m_history;
-        m_history = HistoryNode{m_next_history_id++, nullptr};
+        reset_history();
 
         m_changes.push_back({ Change::Erase, {0,0}, line_count() });
-        static_cast<BufferLines&>(m_lines) = std::move(parsed_lines.lines);
+        m_lines.assign(std::move(parsed_lines.lines));
         m_changes.push_back({ Change::Insert, {0,0}, line_count() });
     }
     else
     {
-        auto diff = find_diff(m_lines.begin(), m_lines.size(),
-                              parsed_lines.lines.begin(), parsed_lines.lines.size(),
-                              [](const StringDataPtr& lhs, const StringDataPtr& rhs)
-                              { return lhs->strview() == rhs->strview(); });
-
-        auto it = m_lines.begin();
+        Vector<StringView> old_lines{m_lines.begin(), m_lines.end()};
+        Vector<StringView> new_lines;
+        new_lines.reserve(parsed_lines.lines.size());
+        for (auto& line : parsed_lines.lines)
+            new_lines.push_back(line->strview());
+        auto diff = find_diff_hashed(old_lines.begin(), (int)old_lines.size(),
+                                     new_lines.begin(), (int)new_lines.size());
+
+        LineCount cur_line = 0;
         for (auto& d : diff)
         {
             if (d.mode == Diff::Keep)
-                it += d.len;
+                cur_line += d.len;
             else if (d.mode == Diff::Add)
             {
-                const LineCount cur_line = (int)(it - m_lines.begin());
-
                 for (LineCount line = 0; line < d.len; ++line)
                     m_current_undo_group.push_back({
                         Modification::Insert, cur_line + line,
                         parsed_lines.lines[(int)(d.posB + line)]});
 
                 m_changes.push_back({ Change::Insert, cur_line, cur_line + d.len });
-                m_lines.insert(it, &parsed_lines.lines[d.posB], &parsed_lines.lines[d.posB + d.len]);
-                it = m_lines.begin() + (int)(cur_line + d.len);
+                m_lines.insert(cur_line, parsed_lines.lines.begin() + d.posB,
+                               parsed_lines.lines.begin() + d.posB + d.len);
+                cur_line += d.len;
             }
             else if (d.mode == Diff::Remove)
             {
-                const LineCount cur_line = (int)(it - m_lines.begin());
-
                 for (LineCount line = d.len-1; line >= 0; --line)
                     m_current_undo_group.push_back({
                         Modification::Erase, cur_line + line,
                         m_lines.get_storage(cur_line + line)});
 
-                it = m_lines.erase(it, it + d.len);
+                m_lines.erase(cur_line, cur_line + d.len);
                 m_changes.push_back({ Change::Erase, cur_line, cur_line + d.len });
             }
         }
@@ -310,9 +443,226 @@ void Buffer::commit_undo_group()
     node->undo_group = std::move(m_current_undo_group);
     m_current_undo_group.clear();
 
+    node->size = node->undo_group.size() * sizeof(Modification);
+    for (auto& modification : node->undo_group)
+        node->size += modification.content->length;
+    m_history_size += node->size;
+
     m_history_cursor->childs.emplace_back(node);
     m_history_cursor->redo_child = node;
     m_history_cursor = node;
+
+    if (m_undo_journal and m_undo_journal->persistent())
+        write_history_record(UndoJournal::Record::Node, *node);
+
+    limit_history_memory();
+}
+
+void Buffer::limit_history_memory()
+{
+    const int limit = options()["history_memory_limit"].get<int>();
+    if (limit == 0 or m_history_size <= (size_t)limit)
+        return;
+
+    Vector<HistoryNode*, MemoryDomain::BufferMeta> nodes;
+    Vector<HistoryNode*, MemoryDomain::BufferMeta> to_visit{&m_history};
+    while (not to_visit.empty())
+    {
+        HistoryNode* node = to_visit.back();
+        to_visit.pop_back();
+        if (not node->spilled and not node->undo_group.empty() and
+            node != m_history_cursor.get())
+            nodes.push_back(node);
+        for (auto& child : node->childs)
+            to_visit.push_back(child.get());
+    }
+    std::sort(nodes.begin(), nodes.end(),
+              [](HistoryNode* lhs, HistoryNode* rhs) { return lhs->id < rhs->id; });
+
+    // Go well below the limit so that this does not happen on every commit
+    for (auto* node : nodes)
+    {
+        if (m_history_size <= (size_t)limit / 2 or not spill_history_node(*node))
+            break;
+    }
+}
+
+bool Buffer::spill_history_node(HistoryNode& node)
+{
+    if (not node.journal_location)
+    {
+        // Persistent journals only hold records, written on commit
+        if (m_undo_journal and m_undo_journal->persistent())
+            return false;
+        if (not m_undo_journal)
+            m_undo_journal = std::make_unique<UndoJournal>();
+        node.journal_location = m_undo_journal->write(serialize(node.undo_group));
+        if (not node.journal_location)
+            return false;
+    }
+
+    node.undo_group = UndoGroup{};
+    node.spilled = true;
+    m_history_size -= node.size;
+    m_spilled_history_size += node.size;
+    return true;
+}
+
+bool Buffer::load_history_node(HistoryNode& node) noexcept
+{
+    if (not node.spilled)
+        return true;
+
+    auto data = m_undo_journal->read(*node.journal_location);
+    if (not data)
+    {
+        write_to_debug_buffer(format("could not read undo history of '{}' from its journal",
+                                     m_display_name));
+        return false;
+    }
+
+    auto undo_group = deserialize(*data);
+    if (not undo_group)
+    {
+        write_to_debug_buffer(format("invalid undo history of '{}' in its journal, dropping it",
+                                     m_display_name));
+        reset_history();
+        return false;
+    }
+
+    node.undo_group = std::move(*undo_group);
+    node.spilled = false;
+    m_history_size += node.size;
+    m_spilled_history_size -= node.size;
+    return true;
+}
+
+void Buffer::reset_history()
+{
+    const bool modified = is_modified();
+    m_history_cursor = &m_history;
+    m_last_save_history_cursor = modified ? nullptr : &m_history;
+    m_current_undo_group.clear();
+    m_history = HistoryNode{m_next_history_id++, nullptr};
+    m_history_size = 0;
+    m_spilled_history_size = 0;
+    if (m_undo_journal and m_undo_journal->persistent() and m_undo_journal->clear())
+        write_history_record(UndoJournal::Record::Root, m_history);
+    else
+        m_undo_journal.reset();
+}
+
+String Buffer::serialize(const UndoGroup& undo_group)
+{
+    String data;
+    for (auto& modification : undo_group)
+    {
+        const int32_t header[] = { modification.type, (int)modification.coord.line,
+                                   (int)modification.coord.column, modification.content->length };
+        data.append((const char*)header, sizeof(header));
+        data += modification.content->strview();
+    }
+    return data;
+}
+
+Optional<Buffer::UndoGroup> Buffer::deserialize(StringView data)
+{
+    UndoGroup undo_group;
+    for (const char* pos = data.begin(); pos != data.end();)
+    {
+        int32_t header[4];
+        if (data.end() - pos < (ptrdiff_t)sizeof(header))
+            return {};
+        memcpy(header, pos, sizeof(header));
+        pos += sizeof(header);
+        if ((header[0] != Modification::Insert and header[0] != Modification::Erase) or
+            header[1] < 0 or header[2] < 0 or header[3] <= 0 or data.end() - pos < header[3])
+            return {};
+        undo_group.push_back({(Modification::Type)header[0], {header[1], header[2]},
+                              StringData::create({{pos, pos + header[3]}})});
+        pos += header[3];
+    }
+    return undo_group;
+}
+
+size_t Buffer::file_content_key() const
+{
+    if (is_modified())
+        return 0;
+    return hash_values(m_lines.byte_count(), (size_t)m_fs_timestamp.tv_sec,
+                       (size_t)m_fs_timestamp.tv_nsec);
+}
+
+void Buffer::write_history_record(UndoJournal::Record::Type type, HistoryNode& node)
+{
+    using Record = UndoJournal::Record;
+    if (type == Record::Node)
+    {
+        String payload = serialize(node.undo_group);
+        node.journal_location = m_undo_journal->write_record(
+            {type, (uint32_t)(int)payload.length(), node.id, node.parent->id}, payload);
+    }
+    else
+        m_undo_journal->write_record({type, 0, node.id, file_content_key()});
+}
+
+void Buffer::open_history_journal()
+{
+    const String& dir = options()["undo_journal_dir"].get<String>();
+    if (dir.empty() or not (m_flags & Flags::File) or (m_flags & Flags::NoUndo))
+        return;
+    kak_assert(m_history_cursor.get() == &m_history and m_history.childs.empty());
+
+    auto journal = std::make_unique<UndoJournal>();
+    if (not journal->open(format("{}/{}.undo", dir, hash_value(m_name)), m_name))
+    {
+        write_to_debug_buffer(format("could not open undo journal of '{}' in '{}'",
+                                     m_display_name, dir));
+        return;
+    }
+    m_undo_journal = std::move(journal);
+
+    using Record = UndoJournal::Record;
+    const auto records = m_undo_journal->records();
+    const size_t key = file_content_key();
+    auto saved = std::find_if(records.rbegin(), records.rend(), [key](auto& record) {
+        return (record.first.type == Record::Root or record.first.type == Record::Save) and
+               record.first.value == key;
+    });
+    if (records.empty() or records[0].first.type != Record::Root or saved == records.rend())
+        return reset_history();
+
+    // Only rebuild the tree, undo groups are read when needed
+    m_history.id = records[0].first.id;
+    HashMap<size_t, HistoryNode*, MemoryDomain::BufferMeta> nodes;
+    nodes.insert({m_history.id, &m_history});
+    for (auto& record : records)
+    {
+        auto parent = nodes.find(record.first.value);
+        if (record.first.type != Record::Node or parent == nodes.end())
+            continue;
+        auto* node = new HistoryNode{record.first.id, parent->value};
+        node->size = record.second.size;
+        node->spilled = true;
+        node->journal_location = record.second;
+        m_spilled_history_size += node->size;
+        parent->value->childs.emplace_back(node);
+        parent->value->redo_child = node;
+        nodes.insert({node->id, node});
+        m_next_history_id = std::max(m_next_history_id, node->id + 1);
+    }
+    m_next_history_id = std::max(m_next_history_id, m_history.id + 1);
+
+    // The history only applies to the content it was saved with, an invalid
+    // record already dropped it
+    auto cursor = nodes.find(saved->first.id);
+    if (cursor == nodes.end())
+        return reset_history();
+    if (load_history_node(*cursor->value))
+    {
+        m_history_cursor = cursor->value;
+        m_last_save_history_cursor = cursor->value;
+    }
 }
 
 bool Buffer::undo(size_t count) noexcept
@@ -324,6 +674,10 @@ bool Buffer::undo(size_t count) noexcept
 
     while (count-- != 0 and m_history_cursor->parent)
     {
+        // Keep the cursor node in memory
+        if (not load_history_node(*m_history_cursor->parent))
+            break;
+
         for (const Modification& modification : m_history_cursor->undo_group | reverse())
             apply_modification(modification.inverse());
 
@@ -342,6 +696,8 @@ bool Buffer::redo(size_t count) noexcept
 
     while (count-- != 0 and m_history_cursor->redo_child)
     {
+        if (not load_history_node(*m_history_cursor->redo_child))
+            break;
         m_history_cursor = m_history_cursor->redo_child;
 
         for (const Modification& modification : m_history_cursor->undo_group)
@@ -350,7 +706,7 @@ bool Buffer::redo(size_t count) noexcept
     return true;
 }
 
-void Buffer::move_to(HistoryNode* history_node) noexcept
+bool Buffer::move_to(HistoryNode* history_node) noexcept
 {
     commit_undo_group();
 
@@ -380,6 +736,15 @@ void Buffer::move_to(HistoryNode* history_node) noexcept
 
     auto parent = find_lowest_common_parent(m_history_cursor.get(), history_node);
 
+    for (auto* node : { m_history_cursor.get(), history_node })
+    {
+        for (auto it = node; it != parent; it = it->parent.get())
+        {
+            if (not load_history_node(*it))
+                return false;
+        }
+    }
+
     // undo up to common parent
     for (auto it = m_history_cursor.get(); it != parent; it = it->parent.get())
     {
@@ -402,6 +767,7 @@ void Buffer::move_to(HistoryNode* history_node) noexcept
 
     apply_from_parent(*this, parent, history_node);
     m_history_cursor = history_node;
+    return true;
 }
 
 template<typename Func>
@@ -426,8 +792,7 @@ bool Buffer::move_to(size_t history_id) noexcept
     if (not target_node)
         return false;
 
-    move_to(target_node);
-    return true;
+    return move_to(target_node);
 }
 
 size_t Buffer::current_history_id() const noexcept
@@ -435,14 +800,48 @@ size_t Buffer::current_history_id() const noexcept
     return m_history_cursor->id;
 }
 
+void Buffer::register_change_checkpoint(const size_t& timestamp) const
+{
+    kak_assert(not contains(m_change_checkpoints, &timestamp));
+    m_change_checkpoints.push_back(&timestamp);
+}
+
+void Buffer::unregister_change_checkpoint(const size_t& timestamp) const
+{
+    auto it = find(m_change_checkpoints, &timestamp);
+    kak_assert(it != m_change_checkpoints.end());
+    m_change_checkpoints.erase(it);
+}
+
+void Buffer::compact_changes(size_t min_kept, size_t max_kept)
+{
+    if (m_changes.size() <= 2 * min_kept)
+        return;
+
+    const size_t current = timestamp();
+    size_t keep_from = current - min_kept;
+    for (auto* checkpoint : m_change_checkpoints)
+        keep_from = std::min(keep_from, *checkpoint);
+    if (current > max_kept)
+        keep_from = std::max(keep_from, current - max_kept);
+    keep_from = std::max(keep_from, m_first_change_timestamp);
+
+    if (keep_from == m_first_change_timestamp)
+        return;
+
+    m_changes.erase(m_changes.begin(), m_changes.begin() + (keep_from - m_first_change_timestamp));
+    m_first_change_timestamp = keep_from;
+}
+
 void Buffer::check_invariant() const
 {
 #ifdef KAK_DEBUG
     kak_assert(not m_lines.empty());
-    for (auto& line : m_lines)
+    m_lines.check_invariant();
+    for (auto line : m_lines)
     {
-        kak_assert(line->strview().length() > 0);
-        kak_assert(line->strview().back() == '\n');
+        kak_assert(line.length() > 0);
+        kak_assert(line.back() == '\n');
     }
 #endif
 }
@@ -462,7 +861,7 @@ BufferCoord Buffer::do_insert(BufferCoord pos, StringView content)
     const StringView suffix = at_end ?
         StringView{} : m_lines[pos.line].substr(pos.column);
 
-    LineList new_lines;
+    BufferLines new_lines;
     ByteCount start = 0;
     for (ByteCount i = 0; i < content.length(); ++i)
     {
@@ -478,14 +877,12 @@ BufferCoord Buffer::do_insert(BufferCoord pos, StringView content)
     else if (start != content.length() or not suffix.empty())
         new_lines.push_back(StringData::create({content.substr(start), suffix}));
 
-    auto line_it = m_lines.begin() + (int)pos.line;
+    LineCount line = pos.line;
     auto new_lines_it = new_lines.begin();
     if (not append_lines) // replace first line with new first line
-        *line_it++ = std::move(*new_lines_it++);
+        m_lines.set(line++, std::move(*new_lines_it++));
 
-    m_lines.insert(line_it,
-                   std::make_move_iterator(new_lines_it),
-                   std::make_move_iterator(new_lines.end()));
+    m_lines.insert(line, new_lines_it, new_lines.end());
 
     const LineCount last_line = pos.line + new_lines.size() - 1;
     const auto end = at_end ? line_count()
@@ -509,13 +906,13 @@ BufferCoord Buffer::do_erase(BufferCoord begin, BufferCoord end)
     if (not prefix.empty() or not suffix.empty())
     {
         auto new_line = StringData::create({prefix, suffix});
-        m_lines.erase(m_lines.begin() + (int)begin.line, m_lines.begin() + (int)end.line);
-        m_lines.get_storage(begin.line) = std::move(new_line);
+        m_lines.erase(begin.line, end.line);
+        m_lines.set(begin.line, std::move(new_line));
         next = begin;
     }
     else
     {
-        m_lines.erase(m_lines.begin() + (int)begin.line, m_lines.begin() + (int)end.line);
+        m_lines.erase(begin.line, end.line);
         next = begin.line;
     }
 
@@ -610,35 +1007,26 @@ void Buffer::notify_saved()
     m_flags &= ~Flags::New;
     m_last_save_history_cursor = m_history_cursor;
     m_fs_timestamp = get_fs_timestamp(m_name);
+
+    if (m_undo_journal and m_undo_journal->persistent())
+        write_history_record(UndoJournal::Record::Save, *m_history_cursor);
 }
 
 BufferCoord Buffer::advance(BufferCoord coord, ByteCount count) const
 {
-    if (count > 0)
-    {
-        auto line = coord.line;
-        count += coord.column;
-        while (count >= m_lines[line].length())
-        {
-            count -= m_lines[line++].length();
-            if (line == line_count())
-                return end_coord();
-        }
-        return { line, count };
-    }
-    else if (count < 0)
-    {
-        auto line = coord.line;
-        count += coord.column;
-        while (count < 0)
-        {
-            count += m_lines[--line].length();
-            if (line < 0)
-                return {0, 0};
-        }
-        return { line, count };
-    }
-    return coord;
+    const ByteCount column = coord.column + count;
+    if (column >= 0 and coord.line < line_count() and column < m_lines[coord.line].length())
+        return { coord.line, column };
+    return byte_coord(byte_offset(coord) + count);
+}
+
+BufferCoord Buffer::byte_coord(ByteCount offset) const
+{
+    if (offset < 0)
+        return {0, 0};
+    if ((size_t)(int)offset >= m_lines.byte_count())
+        return end_coord();
+    return m_lines.byte_coord((size_t)(int)offset);
 }
 
 BufferCoord Buffer::char_next(BufferCoord coord) const
@@ -686,6 +1074,19 @@ void Buffer::on_option_changed(const Option& option)
         else
             m_flags &= ~Flags::ReadOnly;
     }
+    else if (option.name() == "intern_lines")
+        m_lines.set_interned(option.get<bool>());
+    else if (option.name() == "cold_lines_compression_delay")
+    {
+        const auto delay = std::chrono::seconds{option.get<int>()};
+        if (delay.count() <= 0)
+            m_cold_lines_timer.reset();
+        else
+            m_cold_lines_timer = std::make_unique<Timer>(Clock::now() + delay, [this, delay](Timer& timer) {
+                m_lines.compress_cold_chunks();
+                timer.set_next_date(Clock::now() + delay);
+            });
+    }
     run_hook_in_own_context("BufSetOption",
                             format("{}={}", option.name(), option.get_as_string()));
 }
@@ -711,8 +1112,8 @@ BufferCoord Buffer::last_modification_coord() const
 String Buffer::debug_description() const
 {
     size_t content_size = 0;
-    for (auto& line : m_lines)
-        content_size += (int)line->strview().length();
+    for (auto line : m_lines)
+        content_size += (int)line.length();
 
     static size_t (*count_mem)(const HistoryNode&) = [](const HistoryNode& node) {
         size_t size = node.undo_group.size() * sizeof(Modification);
@@ -787,6 +1188,8 @@ UnitTest test_buffer{[]()
     BufferIterator pos2 = buffer.end();
     pos2 -= 9;
     kak_assert(*pos2 == '?');
+    pos2 += 9;
+    kak_assert(pos2 == buffer.end());
 
     String str = buffer.string({ 4, 1 }, buffer.next({ 4, 5 }));
     kak_assert(str == "youpi");
@@ -808,6 +1211,24 @@ UnitTest test_buffer{[]()
     kak_assert(buffer.string(buffer.advance(buffer.end_coord(), -7), buffer.end_coord()) == StringView{"kanaky\n"});
     buffer.redo();
     kak_assert(buffer.string(buffer.advance(buffer.end_coord(), -6), buffer.end_coord()) == StringView{"mutch\n"});
+
+    String content;
+    for (int i = 0; i < 100; ++i)
+        content += format("line {}\n", i);
+    Buffer long_buffer("long", Buffer::Flags::None, content);
+    kak_assert(long_buffer.byte_offset({50, 2}) == 10 * 7 + 40 * 8 + 2);
+    kak_assert(long_buffer.byte_coord(10 * 7 + 40 * 8 + 2) == BufferCoord{50, 2});
+    kak_assert(long_buffer.distance({1, 3}, {50, 2}) == 382);
+    kak_assert(long_buffer.distance({50, 2}, {1, 3}) == -382);
+    kak_assert(long_buffer.advance({1, 3}, 382) == BufferCoord{50, 2});
+    kak_assert(long_buffer.advance({50, 2}, -382) == BufferCoord{1, 3});
+    kak_assert(long_buffer.advance({50, 2}, -1000) == BufferCoord{0, 0});
+    kak_assert(long_buffer.advance({50, 2}, 1000) == long_buffer.end_coord());
+    kak_assert(long_buffer.end() - long_buffer.begin() == content.length());
+    long_buffer.erase({20, 0}, {30, 0});
+    kak_assert(long_buffer.byte_coord(10 * 7 + 30 * 8 + 2) == BufferCoord{40, 2});
+    long_buffer.insert({5, 1}, "abc");
+    kak_assert(long_buffer.byte_offset({40, 2}) == 10 * 7 + 30 * 8 + 5);
 }};
 
 UnitTest test_undo{[]()
@@ -852,4 +1273,78 @@ UnitTest test_undo{[]()
     kak_assert(buffer[4_line] == " youpi\n");
 }};
 
+
+UnitTest test_spilled_undo{[]()
+{
+    Buffer buffer("test", Buffer::Flags::None, "allo ?\n");
+    buffer.options().get_local_option("history_memory_limit").set(1);
+
+    const String expected = "allo ?\n";
+    for (int i = 0; i < 20; ++i)
+    {
+        buffer.insert({0, 4}, format("{}\n", i));
+        buffer.commit_undo_group();
+    }
+    kak_assert(buffer.spilled_history_size() > 0);
+    const String modified = buffer.string({0, 0}, buffer.end_coord());
+
+    buffer.undo(20);
+    kak_assert(buffer.string({0, 0}, buffer.end_coord()) == expected);
+    buffer.redo(20);
+    kak_assert(buffer.string({0, 0}, buffer.end_coord()) == modified);
+
+    const size_t last_id = buffer.current_history_id();
+    kak_assert(buffer.move_to(last_id - 10));
+    kak_assert(buffer.move_to(last_id));
+    kak_assert(buffer.string({0, 0}, buffer.end_coord()) == modified);
+    kak_assert(buffer.move_to(last_id - 20));
+    kak_assert(buffer.string({0, 0}, buffer.end_coord()) == expected);
+}};
+
+UnitTest test_change_compaction{[]()
+{
+    Buffer buffer("test", Buffer::Flags::None, "\n");
+    const size_t start = buffer.timestamp();
+    size_t checkpoint = start;
+    buffer.register_change_checkpoint(checkpoint);
+
+    // small thresholds so that a few changes are enough to compact
+    constexpr size_t min_kept = 16, max_kept = 64;
+    for (int i = 0; i < 48; ++i)
+        buffer.insert({0, 0}, "a");
+    const size_t timestamp = buffer.timestamp();
+    kak_assert(timestamp == start + 48);
+
+    buffer.compact_changes(min_kept, max_kept);
+    kak_assert(not buffer.changes_discarded(checkpoint));
+    kak_assert(buffer.changes_since(checkpoint).size() == 48);
+
+    checkpoint += 8;
+    buffer.compact_changes(min_kept, max_kept);
+    kak_assert(buffer.changes_discarded(start));
+    kak_assert(buffer.changes_since(checkpoint).size() == 48 - 8);
+    kak_assert(buffer.timestamp() == timestamp);
+
+    buffer.unregister_change_checkpoint(checkpoint);
+    buffer.compact_changes(min_kept, max_kept);
+    kak_assert(buffer.changes_discarded(checkpoint));
+    kak_assert(not buffer.changes_discarded(timestamp - min_kept));
+    kak_assert(buffer.changes_since(timestamp - min_kept).size() == min_kept);
+
+    // checkpoints do not keep more than max_kept changes alive
+    checkpoint = buffer.timestamp();
+    buffer.register_change_checkpoint(checkpoint);
+    for (int i = 0; i < 80; ++i)
+        buffer.insert({0, 0}, "a");
+    buffer.compact_changes(min_kept, max_kept);
+    kak_assert(buffer.changes_discarded(checkpoint));
+    kak_assert(buffer.changes_since(buffer.timestamp() - max_kept).size() == max_kept);
+    buffer.unregister_change_checkpoint(checkpoint);
+
+    const size_t last = buffer.timestamp();
+    buffer.insert({0, 0}, "b");
+    kak_assert(buffer.timestamp() == last + 1);
+    kak_assert(buffer.changes_since(last).size() == 1);
+}};
+
 }
@@ -5,9 +5,11 @@
 #include "coord.hh"
 #include "constexpr_utils.hh"
 #include "enum.hh"
+#include "line_list.hh"
 #include "safe_ptr.hh"
 #include "scope.hh"
 #include "shared_string.hh"
+#include "undo_journal.hh"
 #include "value.hh"
 #include "vector.hh"
 
@@ -45,6 +47,8 @@ constexpr auto enum_desc(Meta::Type<ByteOrderMark>)
 }
 
 class Buffer;
+class BufferSnapshot;
+class Timer;
 
 constexpr timespec InvalidTime = { -1, -1 };
 
@@ -60,7 +64,7 @@ public:
     // costly, so this is not strictly random access
     using iterator_category = std::bidirectional_iterator_tag;
 
-    BufferIterator() noexcept : m_buffer(nullptr) {}
+    BufferIterator() noexcept : m_buffer(nullptr), m_line_count{}, m_line{} {}
     BufferIterator(const Buffer& buffer, BufferCoord coord) noexcept;
 
     bool operator== (const BufferIterator& iterator) const noexcept;
@@ -88,6 +92,13 @@ public:
 
     const BufferCoord& coord() const noexcept { return m_coord; }
 
+    // the bytes from this iterator to the end of its line, or to end if it
+    // comes first, which can be read directly
+    StringView contiguous_bytes(const BufferIterator& end) const noexcept;
+    // the bytes before this iterator, from the start of its line or from
+    // begin if it comes later
+    StringView contiguous_bytes_before(const BufferIterator& begin) const noexcept;
+
 private:
     SafePtr<const Buffer> m_buffer;
     BufferCoord m_coord;
@@ -95,8 +106,6 @@ private:
     StringView m_line;
 };
 
-using BufferLines = Vector<StringDataPtr, MemoryDomain::BufferContent>;
-
 // A Buffer is a in-memory representation of a file
 //
 // The Buffer class permits to read and mutate this file
@@ -118,8 +127,9 @@ public:
     };
     friend constexpr bool with_bit_ops(Meta::Type<Flags>) { return true; }
 
+    // When data comes from mapping, lines can be read from it lazily
     Buffer(String name, Flags flags, StringView data = {},
-           timespec fs_timestamp = InvalidTime);
+           timespec fs_timestamp = InvalidTime, RefPtr<MappedFile> mapping = {});
     Buffer(const Buffer&) = delete;
     Buffer& operator= (const Buffer&) = delete;
     ~Buffer();
@@ -145,12 +155,20 @@ public:
     size_t         current_history_id() const noexcept;
     size_t         next_history_id() const noexcept { return m_next_history_id; }
 
+    // memory used by the undo history, and by the part moved to the journal
+    size_t         history_size() const { return m_history_size; }
+    size_t         spilled_history_size() const { return m_spilled_history_size; }
+
     String         string(BufferCoord begin, BufferCoord end) const;
     StringView     substr(BufferCoord begin, BufferCoord end) const;
 
     const char&    byte_at(BufferCoord c) const;
     ByteCount      distance(BufferCoord begin, BufferCoord end) const;
     BufferCoord    advance(BufferCoord coord, ByteCount count) const;
+    // conversions between coordinates and offsets from the buffer start,
+    // offsets out of the buffer are clamped
+    ByteCount      byte_offset(BufferCoord coord) const;
+    BufferCoord    byte_coord(ByteCount offset) const;
     BufferCoord    next(BufferCoord coord) const;
     BufferCoord    prev(BufferCoord coord) const;
 
@@ -175,6 +193,14 @@ public:
     const StringDataPtr& line_storage(LineCount line) const
     { return m_lines.get_storage(line); }
 
+    // file some lines are still read from, if any
+    const MappedFile* mapped_file() const { return m_lines.mapping(); }
+    // copy lines read from the mapped file so that it can be modified
+    void materialize_lines() { m_lines.materialize(); }
+
+    // returns an immutable view of the current lines, see BufferSnapshot
+    BufferSnapshot snapshot() const;
+
     // returns an iterator at given coordinates. clamp line_and_column
     BufferIterator iterator_at(BufferCoord coord) const;
 
@@ -212,6 +238,21 @@ public:
     };
     ConstArrayView<Change> changes_since(size_t timestamp) const;
 
+    // Changes older than the oldest registered checkpoint can be discarded
+    // by compact_changes, consumers holding such a timestamp need to drop
+    // their state instead of updating it.
+    bool changes_discarded(size_t timestamp) const;
+    void register_change_checkpoint(const size_t& timestamp) const;
+    void unregister_change_checkpoint(const size_t& timestamp) const;
+
+    // Recent changes are always kept so that short lived timestamps, which
+    // are not registered, can still be updated. Registered checkpoints keep
+    // older changes alive, up to max_kept changes.
+    static constexpr size_t default_min_kept_changes = 16 * 1024;
+    static constexpr size_t default_max_kept_changes = 256 * 1024;
+    void compact_changes(size_t min_kept = default_min_kept_changes,
+                         size_t max_kept = default_max_kept_changes);
+
     String debug_description() const;
 
     // Methods called by the buffer manager
@@ -229,24 +270,13 @@ private:
     void apply_modification(const Modification& modification);
     void revert_modification(const Modification& modification);
 
-    struct LineList : BufferLines
-    {
-        [[gnu::always_inline]]
-        StringDataPtr& get_storage(LineCount line)
-        { return BufferLines::operator[]((int)line); }
-
-        [[gnu::always_inline]]
-        const StringDataPtr& get_storage(LineCount line) const
-        { return BufferLines::operator[]((int)line); }
-
-        [[gnu::always_inline]]
-        StringView operator[](LineCount line) const
-        { return get_storage(line)->strview(); }
-
-        StringView front() const { return BufferLines::front()->strview(); }
-        StringView back() const { return BufferLines::back()->strview(); }
-    };
     LineList m_lines;
+    // compresses the lines that were not accessed since its previous run,
+    // set when the cold_lines_compression_delay option is not 0
+    std::unique_ptr<Timer> m_cold_lines_timer;
+    // materializes the lines or releases their mapping once the mapped file
+    // is about to be modified, the lease signal can arrive during a search
+    std::unique_ptr<Timer> m_materialize_timer;
 
     String m_name;
     String m_display_name;
@@ -264,6 +294,9 @@ private:
         HistoryNode* redo_child = nullptr; // not a SafePtr to avoid lifetime issues between this and childs
         size_t id;
         TimePoint timepoint;
+        size_t size = 0; // memory used by undo_group
+        bool spilled = false; // undo_group is only in the journal
+        Optional<UndoJournal::Location> journal_location;
     };
 
     size_t                m_next_history_id = 0;
@@ -272,11 +305,42 @@ private:
     SafePtr<HistoryNode>  m_last_save_history_cursor;
     UndoGroup             m_current_undo_group;
 
-    void move_to(HistoryNode* history_node) noexcept;
+    size_t                m_history_size = 0;
+    size_t                m_spilled_history_size = 0;
+    std::unique_ptr<UndoJournal> m_undo_journal;
+
+    bool move_to(HistoryNode* history_node) noexcept;
+
+    // Moves the oldest undo groups to the journal when the history uses
+    // more than the history_memory_limit option
+    void limit_history_memory();
+    bool spill_history_node(HistoryNode& node);
+    // Reads back the undo group of the node if it was spilled. When its
+    // record is invalid, the journal is dropped along with the history,
+    // node included, which restarts from the current content.
+    bool load_history_node(HistoryNode& node) noexcept;
+    // Restarts the history from the current content, which stays modified
+    // if it was
+    void reset_history();
+
+    // Opens the persistent journal of the file when the undo_journal_dir
+    // option is set, restoring its history if the content is a saved one
+    void open_history_journal();
+    void write_history_record(UndoJournal::Record::Type type, HistoryNode& node);
+    // Identifies the file content the buffer was last read from or written
+    // to by its size and modification time, which avoids reading lazily
+    // loaded lines. 0 when the buffer content differs from it.
+    size_t file_content_key() const;
+
+    static String serialize(const UndoGroup& undo_group);
+    // returns an empty optional if data is not a valid undo group
+    static Optional<UndoGroup> deserialize(StringView data);
 
     template<typename Func> HistoryNode* find_history_node(HistoryNode* node, const Func& func);
 
     Vector<Change, MemoryDomain::BufferMeta> m_changes;
+    size_t m_first_change_timestamp = 0;
+    mutable Vector<const size_t*, MemoryDomain::BufferMeta> m_change_checkpoints;
 
     timespec m_fs_timestamp;
 
@@ -34,6 +34,10 @@ inline ByteCount Buffer::distance(BufferCoord begin, BufferCoord end) const
     if (begin.line == end.line)
         return end.column - begin.column;
 
+    // Summing a few line lengths is cheaper than looking up the byte index
+    if (end.line - begin.line > 8)
+        return byte_offset(end) - byte_offset(begin);
+
     ByteCount res = m_lines[begin.line].length() - begin.column;
     for (LineCount l = begin.line+1; l < end.line; ++l)
         res += m_lines[l].length();
@@ -41,6 +45,11 @@ inline ByteCount Buffer::distance(BufferCoord begin, BufferCoord end) const
     return res;
 }
 
+inline ByteCount Buffer::byte_offset(BufferCoord coord) const
+{
+    return (int)m_lines.byte_offset(coord.line) + coord.column;
+}
+
 inline bool Buffer::is_valid(BufferCoord c) const
 {
     return (c.line >= 0 and c.column >= 0) and
@@ -71,7 +80,7 @@ inline LineCount Buffer::line_count() const
 
 inline size_t Buffer::timestamp() const
 {
-    return m_changes.size();
+    return m_first_change_timestamp + m_changes.size();
 }
 
 inline StringView Buffer::substr(BufferCoord begin, BufferCoord end) const
@@ -82,12 +91,19 @@ inline StringView Buffer::substr(BufferCoord begin, BufferCoord end) const
 
 inline ConstArrayView<Buffer::Change> Buffer::changes_since(size_t timestamp) const
 {
-    if (timestamp < m_changes.size())
-        return { m_changes.data() + timestamp,
+    kak_assert(not changes_discarded(timestamp));
+    const size_t index = timestamp - m_first_change_timestamp;
+    if (timestamp >= m_first_change_timestamp and index < m_changes.size())
+        return { m_changes.data() + index,
                  m_changes.data() + m_changes.size() };
     return {};
 }
 
+inline bool Buffer::changes_discarded(size_t timestamp) const
+{
+    return timestamp < m_first_change_timestamp;
+}
+
 inline BufferCoord Buffer::back_coord() const
 {
     return { line_count() - 1, m_lines.back().length() - 1 };
@@ -167,16 +183,26 @@ inline BufferIterator BufferIterator::operator-(ByteCount size) const
 
 inline BufferIterator& BufferIterator::operator+=(ByteCount size)
 {
+    const ByteCount column = m_coord.column + size;
+    if (column >= 0 and column < m_line.length())
+    {
+        m_coord.column = column;
+        return *this;
+    }
+    if (column == m_line.length() and size > 0) // common when skipping to the line end
+    {
+        m_line = (++m_coord.line < m_line_count) ? (*m_buffer)[m_coord.line] : StringView{};
+        m_coord.column = 0;
+        return *this;
+    }
     m_coord = m_buffer->advance(m_coord, size);
-    m_line = (*m_buffer)[m_coord.line];
+    m_line = (m_coord.line < m_line_count) ? (*m_buffer)[m_coord.line] : StringView{};
     return *this;
 }
 
 inline BufferIterator& BufferIterator::operator-=(ByteCount size)
 {
-    m_coord = m_buffer->advance(m_coord, -size);
-    m_line = (*m_buffer)[m_coord.line];
-    return *this;
+    return *this += -size;
 }
 
 inline BufferIterator& BufferIterator::operator++()
@@ -202,6 +228,20 @@ inline BufferIterator& BufferIterator::operator--()
     return *this;
 }
 
+inline StringView BufferIterator::contiguous_bytes(const BufferIterator& end) const noexcept
+{
+    kak_assert(*this <= end);
+    const ByteCount last = end.m_coord.line == m_coord.line ? end.m_coord.column : m_line.length();
+    return {m_line.begin() + (int)m_coord.column, m_line.begin() + (int)last};
+}
+
+inline StringView BufferIterator::contiguous_bytes_before(const BufferIterator& begin) const noexcept
+{
+    kak_assert(begin <= *this);
+    const ByteCount first = begin.m_coord.line == m_coord.line ? begin.m_coord.column : 0;
+    return {m_line.begin() + (int)first, m_line.begin() + (int)m_coord.column};
+}
+
 inline BufferIterator BufferIterator::operator++(int)
 {
     BufferIterator save = *this;
@@ -25,7 +25,8 @@ BufferManager::~BufferManager()
 }
 
 Buffer* BufferManager::create_buffer(String name, Buffer::Flags flags,
-                                     StringView data, timespec fs_timestamp)
+                                     StringView data, timespec fs_timestamp,
+                                     RefPtr<MappedFile> mapping)
 {
     auto path = real_path(parse_filename(name));
     for (auto& buf : m_buffers)
@@ -36,7 +37,7 @@ Buffer* BufferManager::create_buffer(String name, Buffer::Flags flags,
     }
 
     m_buffers.emplace(m_buffers.begin(),
-                      new Buffer{std::move(name), flags, data, fs_timestamp});
+                      new Buffer{std::move(name), flags, data, fs_timestamp, std::move(mapping)});
     auto& buffer = *m_buffers.front();
     buffer.on_registered();
 
@@ -114,4 +115,10 @@ void BufferManager::clear_buffer_trash()
     m_buffer_trash.clear();
 }
 
+void BufferManager::compact_buffer_changes()
+{
+    for (auto& buffer : m_buffers)
+        buffer->compact_changes();
+}
+
 }
@@ -19,7 +19,8 @@ public:
 
     Buffer* create_buffer(String name, Buffer::Flags flags,
                           StringView data = {},
-                          timespec fs_timestamp = InvalidTime);
+                          timespec fs_timestamp = InvalidTime,
+                          RefPtr<MappedFile> mapping = {});
 
     void delete_buffer(Buffer& buffer);
 
@@ -35,6 +36,7 @@ public:
     void backup_modified_buffers();
 
     void clear_buffer_trash();
+    void compact_buffer_changes();
 private:
     BufferList m_buffers;
     BufferList m_buffer_trash;
@@ -0,0 +1,251 @@
+#include "buffer_snapshot.hh"
+
+#include "buffer.hh"
+#include "lz_codec.hh"
+#include "regex.hh"
+#include "unit_tests.hh"
+
+#include <algorithm>
+#include <thread>
+
+namespace Kakoune
+{
+
+BufferSnapshot::BufferSnapshot(const LineList& lines, size_t timestamp)
+    : m_chunks{lines.m_chunks}, m_mapping{lines.m_mapping}, m_timestamp{timestamp}
+{
+    m_line_starts.reserve(m_chunks.size() + 1);
+    m_byte_starts.reserve(m_chunks.size() + 1);
+    int line = 0;
+    size_t bytes = 0;
+    for (auto& chunk : m_chunks)
+    {
+        m_line_starts.push_back(line);
+        m_byte_starts.push_back(bytes);
+        line += chunk->size();
+        bytes += chunk->bytes;
+    }
+    m_line_starts.push_back(line);
+    m_byte_starts.push_back(bytes);
+    m_unpacked.resize(m_chunks.size());
+}
+
+BufferSnapshot::Location BufferSnapshot::locate(int line) const
+{
+    kak_assert(line >= 0 and line < (int)line_count());
+    if (line < m_line_starts[m_cache_chunk] or line >= m_line_starts[m_cache_chunk + 1])
+        m_cache_chunk = (int)(std::upper_bound(m_line_starts.begin(), m_line_starts.end(), line) -
+                              m_line_starts.begin()) - 1;
+    return {m_cache_chunk, line - m_line_starts[m_cache_chunk]};
+}
+
+StringView BufferSnapshot::operator[](LineCount line) const
+{
+    // Only the members of chunks that the buffer does not modify while
+    // they are shared can be read here
+    const auto loc = locate((int)line);
+    const Chunk& chunk = *m_chunks[loc.chunk];
+    if (chunk.has_lines())
+        return chunk.lines[loc.offset]->strview();
+
+    const char* data = chunk.mapped;
+    if (not data)
+    {
+        auto& unpacked = m_unpacked[loc.chunk];
+        if (unpacked.empty())
+        {
+            unpacked.resize(chunk.bytes);
+            lz_decompress(chunk.packed.data(), chunk.packed.size(), unpacked.data(), chunk.bytes);
+        }
+        data = unpacked.data();
+    }
+    return {data + (loc.offset == 0 ? 0 : chunk.ends[loc.offset-1]),
+            data + chunk.ends[loc.offset]};
+}
+
+String BufferSnapshot::string(BufferCoord begin, BufferCoord end) const
+{
+    String res;
+    const auto last_line = std::min(end.line, line_count()-1);
+    for (auto line = begin.line; line <= last_line; ++line)
+    {
+        ByteCount start = 0;
+        if (line == begin.line)
+            start = begin.column;
+        ByteCount count = -1;
+        if (line == end.line)
+            count = end.column - start;
+        res += (*this)[line].substr(start, count);
+    }
+    return res;
+}
+
+StringView BufferSnapshot::substr(BufferCoord begin, BufferCoord end) const
+{
+    kak_assert(begin.line == end.line);
+    return (*this)[begin.line].substr(begin.column, end.column - begin.column);
+}
+
+const char& BufferSnapshot::byte_at(BufferCoord c) const
+{
+    kak_assert(c.line < line_count() and c.column < (*this)[c.line].length());
+    return (*this)[c.line][c.column];
+}
+
+ByteCount BufferSnapshot::distance(BufferCoord begin, BufferCoord end) const
+{
+    if (begin > end)
+        return -distance(end, begin);
+    if (begin.line == end.line)
+        return end.column - begin.column;
+    return byte_offset(end) - byte_offset(begin);
+}
+
+BufferCoord BufferSnapshot::advance(BufferCoord coord, ByteCount count) const
+{
+    const ByteCount column = coord.column + count;
+    if (column >= 0 and coord.line < line_count() and column < (*this)[coord.line].length())
+        return { coord.line, column };
+    return byte_coord(byte_offset(coord) + count);
+}
+
+ByteCount BufferSnapshot::byte_offset(BufferCoord coord) const
+{
+    if (coord.line >= line_count())
+        return (int)m_byte_starts.back();
+
+    const auto loc = locate((int)coord.line);
+    size_t offset = m_byte_starts[loc.chunk];
+    for (int line = m_line_starts[loc.chunk]; line < (int)coord.line; ++line)
+        offset += (int)(*this)[LineCount{line}].length();
+    return (int)offset + coord.column;
+}
+
+BufferCoord BufferSnapshot::byte_coord(ByteCount offset) const
+{
+    if (offset < 0)
+        return {0, 0};
+    if ((size_t)(int)offset >= m_byte_starts.back())
+        return end_coord();
+
+    const int chunk = (int)(std::upper_bound(m_byte_starts.begin(), m_byte_starts.end(), (size_t)(int)offset) -
+                            m_byte_starts.begin()) - 1;
+    ByteCount remaining = offset - (int)m_byte_starts[chunk];
+    LineCount line = m_line_starts[chunk];
+    for (ByteCount length; remaining >= (length = (*this)[line].length()); ++line)
+        remaining -= length;
+    return {line, remaining};
+}
+
+BufferCoord BufferSnapshot::back_coord() const
+{
+    return { line_count() - 1, (*this)[line_count() - 1].length() - 1 };
+}
+
+bool BufferSnapshot::is_valid(BufferCoord c) const
+{
+    return (c.line >= 0 and c.column >= 0) and
+           ((c.line < line_count() and c.column < (*this)[c.line].length()) or
+            (c.line == line_count() and c.column == 0));
+}
+
+const char& BufferSnapshotIterator::operator[](size_t n) const noexcept
+{
+    return m_snapshot->byte_at(m_snapshot->advance(m_coord, n));
+}
+
+size_t BufferSnapshotIterator::operator-(const BufferSnapshotIterator& iterator) const
+{
+    kak_assert(m_snapshot == iterator.m_snapshot);
+    return (size_t)m_snapshot->distance(iterator.m_coord, m_coord);
+}
+
+BufferSnapshotIterator BufferSnapshotIterator::operator+(ByteCount size) const
+{
+    kak_assert(m_snapshot);
+    return { *m_snapshot, m_snapshot->advance(m_coord, size) };
+}
+
+BufferSnapshotIterator BufferSnapshotIterator::operator-(ByteCount size) const
+{
+    return { *m_snapshot, m_snapshot->advance(m_coord, -size) };
+}
+
+BufferSnapshotIterator& BufferSnapshotIterator::operator+=(ByteCount size)
+{
+    const ByteCount column = m_coord.column + size;
+    if (column >= 0 and column < m_line.length())
+    {
+        m_coord.column = column;
+        return *this;
+    }
+    if (column == m_line.length() and size > 0)
+    {
+        m_line = (++m_coord.line < m_line_count) ? (*m_snapshot)[m_coord.line] : StringView{};
+        m_coord.column = 0;
+        return *this;
+    }
+    return *this = *this + size;
+}
+
+BufferSnapshotIterator& BufferSnapshotIterator::operator-=(ByteCount size)
+{
+    return *this = *this - size;
+}
+
+UnitTest test_buffer_snapshot{[]()
+{
+    Buffer buffer("test", Buffer::Flags::None, "allo ?\nmais que fais la police\nhein ?\n");
+    auto snapshot = buffer.snapshot();
+    kak_assert(snapshot.timestamp() == buffer.timestamp());
+    buffer.insert({1, 0}, "tchou\n");
+    buffer.erase({0, 0}, {1, 0});
+    kak_assert(buffer.line_count() == 3 and buffer[0_line] == "tchou\n");
+
+    kak_assert(snapshot.line_count() == 3);
+    kak_assert(snapshot[1_line] == "mais que fais la police\n");
+    kak_assert(snapshot.string({0, 0}, snapshot.end_coord()) == "allo ?\nmais que fais la police\nhein ?\n");
+    kak_assert(snapshot.substr({1, 5}, {1, 8}) == "que");
+    kak_assert(snapshot.advance({0, 5}, 10) == BufferCoord(1, 8));
+    kak_assert(snapshot.advance({2, 1}, -12) == BufferCoord(1, 13));
+    kak_assert(snapshot.distance({0, 2}, {2, 1}) == 30);
+    String chars;
+    for (auto it = snapshot.end(); it != snapshot.begin(); )
+        chars += *--it;
+    kak_assert(chars == "\n? nieh\necilop al siaf euq siam\n? olla");
+    auto it = snapshot.begin();
+    it += 7;
+    kak_assert(it.coord() == BufferCoord(1, 0) and *it == 'm');
+    it += 31;
+    kak_assert(it == snapshot.end());
+
+    MatchResults<BufferSnapshot::Iterator> matches;
+    kak_assert(regex_search(snapshot.begin(), snapshot.end(), matches, Regex{"po\\w+"}));
+    kak_assert(matches[0].first.coord() == BufferCoord(1, 17) and
+               matches[0].second.coord() == BufferCoord(1, 23));
+
+    // a worker thread reads a snapshot while the buffer is modified, with
+    // enough lines for them to span a few line list chunks
+    String content;
+    for (int i = 0; i < 1500; ++i)
+        content += format("line {}\n", i);
+    Buffer long_buffer("long", Buffer::Flags::None, content);
+    auto long_snapshot = long_buffer.snapshot();
+    String read;
+    WorkerAllocations allocations;
+    std::thread worker{[&] {
+        allocations.count_on_this_thread();
+        for (auto it = long_snapshot.begin(); it != long_snapshot.end(); ++it)
+            read += *it;
+    }};
+    for (int i = 0; i < 50; ++i)
+    {
+        long_buffer.insert({i * 20, 0}, "inserted\n");
+        long_buffer.erase({i * 10, 0}, {i * 10 + 1, 0});
+    }
+    worker.join();
+    kak_assert(read == content);
+    kak_assert(long_snapshot.byte_coord(long_snapshot.byte_offset({1000, 3})) == BufferCoord(1000, 3));
+}};
+
+}
@@ -0,0 +1,173 @@
+#ifndef buffer_snapshot_hh_INCLUDED
+#define buffer_snapshot_hh_INCLUDED
+
+#include "coord.hh"
+#include "line_list.hh"
+#include "string.hh"
+#include "units.hh"
+#include "vector.hh"
+
+namespace Kakoune
+{
+
+class BufferSnapshot;
+
+// Iterates over the characters of a BufferSnapshot, like BufferIterator
+// does for a Buffer
+class BufferSnapshotIterator
+{
+public:
+    using value_type = char;
+    using difference_type = ssize_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    BufferSnapshotIterator() noexcept : m_snapshot(nullptr) {}
+    BufferSnapshotIterator(const BufferSnapshot& snapshot, BufferCoord coord) noexcept;
+
+    bool operator== (const BufferSnapshotIterator& iterator) const noexcept
+    { return m_snapshot == iterator.m_snapshot and m_coord == iterator.m_coord; }
+    bool operator!= (const BufferSnapshotIterator& iterator) const noexcept
+    { return not (*this == iterator); }
+    bool operator<  (const BufferSnapshotIterator& iterator) const noexcept { return m_coord < iterator.m_coord; }
+    bool operator<= (const BufferSnapshotIterator& iterator) const noexcept { return m_coord <= iterator.m_coord; }
+    bool operator>  (const BufferSnapshotIterator& iterator) const noexcept { return m_coord > iterator.m_coord; }
+    bool operator>= (const BufferSnapshotIterator& iterator) const noexcept { return m_coord >= iterator.m_coord; }
+
+    [[gnu::always_inline]]
+    const char& operator* () const noexcept { return m_line[m_coord.column]; }
+    const char& operator[](size_t n) const noexcept;
+    size_t operator- (const BufferSnapshotIterator& iterator) const;
+
+    BufferSnapshotIterator operator+ (ByteCount size) const;
+    BufferSnapshotIterator operator- (ByteCount size) const;
+
+    BufferSnapshotIterator& operator+= (ByteCount size);
+    BufferSnapshotIterator& operator-= (ByteCount size);
+
+    BufferSnapshotIterator& operator++ ();
+    BufferSnapshotIterator& operator-- ();
+
+    BufferSnapshotIterator operator++ (int) { auto save = *this; ++*this; return save; }
+    BufferSnapshotIterator operator-- (int) { auto save = *this; --*this; return save; }
+
+    const BufferCoord& coord() const noexcept { return m_coord; }
+
+    // the bytes from this iterator to the end of its line, or to end if it
+    // comes first, which can be read directly
+    StringView contiguous_bytes(const BufferSnapshotIterator& end) const noexcept
+    {
+        const ByteCount last = end.m_coord.line == m_coord.line ? end.m_coord.column : m_line.length();
+        return {m_line.begin() + (int)m_coord.column, m_line.begin() + (int)last};
+    }
+    // the bytes before this iterator, from the start of its line or from
+    // begin if it comes later
+    StringView contiguous_bytes_before(const BufferSnapshotIterator& begin) const noexcept
+    {
+        const ByteCount first = begin.m_coord.line == m_coord.line ? begin.m_coord.column : 0;
+        return {m_line.begin() + (int)first, m_line.begin() + (int)m_coord.column};
+    }
+
+private:
+    const BufferSnapshot* m_snapshot;
+    BufferCoord m_coord;
+    LineCount m_line_count;
+    StringView m_line;
+};
+
+// A BufferSnapshot is an immutable view of the lines of a buffer at a
+// given timestamp, made by Buffer::snapshot.
+//
+// It shares the line chunks of the buffer, which copies them before
+// modifying them, so taking a snapshot costs O(chunk count) and it stays
+// valid while the buffer is modified or deleted.
+//
+// Snapshots can be read from worker threads while the main thread keeps
+// editing the buffer, as long as each one is only read by one thread at a
+// time. As they update reference counts, snapshots must be created, copied
+// and destroyed on the main thread, moving them is fine.
+class BufferSnapshot
+{
+public:
+    using Iterator = BufferSnapshotIterator;
+
+    BufferSnapshot() = default;
+    BufferSnapshot(const LineList& lines, size_t timestamp);
+
+    size_t timestamp() const { return m_timestamp; }
+    LineCount line_count() const { return LineCount{m_line_starts.empty() ? 0 : m_line_starts.back()}; }
+
+    StringView operator[](LineCount line) const;
+
+    String         string(BufferCoord begin, BufferCoord end) const;
+    StringView     substr(BufferCoord begin, BufferCoord end) const;
+
+    const char&    byte_at(BufferCoord c) const;
+    ByteCount      distance(BufferCoord begin, BufferCoord end) const;
+    BufferCoord    advance(BufferCoord coord, ByteCount count) const;
+    // offsets out of the snapshot are clamped
+    ByteCount      byte_offset(BufferCoord coord) const;
+    BufferCoord    byte_coord(ByteCount offset) const;
+
+    BufferCoord    back_coord() const;
+    BufferCoord    end_coord() const { return line_count(); }
+    bool           is_valid(BufferCoord c) const;
+
+    Iterator       begin() const { return {*this, {0, 0}}; }
+    Iterator       end() const { return {*this, end_coord()}; }
+    // returns an iterator at given coordinates, which must be valid
+    Iterator       iterator_at(BufferCoord coord) const { return {*this, coord}; }
+
+private:
+    using Chunk = LineList::Chunk;
+
+    struct Location
+    {
+        int chunk;
+        int offset;
+    };
+    Location locate(int line) const;
+
+    Vector<RefPtr<Chunk>, MemoryDomain::BufferContent> m_chunks;
+    // first line and first byte of each chunk, followed by the totals
+    Vector<int, MemoryDomain::BufferContent> m_line_starts;
+    Vector<size_t, MemoryDomain::BufferContent> m_byte_starts;
+    RefPtr<MappedFile> m_mapping;
+    // decompressed copies of the compressed chunks, made on first access
+    mutable Vector<Vector<char, MemoryDomain::BufferContent>, MemoryDomain::BufferContent> m_unpacked;
+    size_t m_timestamp = 0;
+    mutable int m_cache_chunk = 0;
+};
+
+inline BufferSnapshotIterator::BufferSnapshotIterator(const BufferSnapshot& snapshot, BufferCoord coord) noexcept
+    : m_snapshot{&snapshot}, m_coord{coord},
+      m_line_count{snapshot.line_count()},
+      m_line{coord.line < snapshot.line_count() ? snapshot[coord.line] : StringView{}} {}
+
+inline BufferSnapshotIterator& BufferSnapshotIterator::operator++()
+{
+    if (++m_coord.column == m_line.length())
+    {
+        m_line = (++m_coord.line < m_line_count) ?
+            (*m_snapshot)[m_coord.line] : StringView{};
+        m_coord.column = 0;
+    }
+    return *this;
+}
+
+inline BufferSnapshotIterator& BufferSnapshotIterator::operator--()
+{
+    if (m_coord.column == 0)
+    {
+        m_line = (*m_snapshot)[--m_coord.line];
+        m_coord.column = m_line.length() - 1;
+    }
+    else
+       --m_coord.column;
+    return *this;
+}
+
+}
+
+#endif // buffer_snapshot_hh_INCLUDED
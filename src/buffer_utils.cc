@@ -61,9 +61,10 @@ ByteCount get_byte_to_column(const Buffer& buffer, ColumnCount tabstop, DisplayC
 
 Buffer* open_file_buffer(StringView filename, Buffer::Flags flags)
 {
-    MappedFile file_data{parse_filename(filename)};
+    RefPtr<MappedFile> file_data{new MappedFile{parse_filename(filename)}};
     return BufferManager::instance().create_buffer(
-        filename.str(), Buffer::Flags::File | flags, file_data, file_data.st.st_mtim);
+        filename.str(), Buffer::Flags::File | flags, *file_data,
+        file_data->st.st_mtim, file_data);
 }
 
 Buffer* open_or_create_file_buffer(StringView filename, Buffer::Flags flags)
@@ -72,9 +73,9 @@ Buffer* open_or_create_file_buffer(StringView filename, Buffer::Flags flags)
     auto path = parse_filename(filename);
     if (file_exists(path))
     {
-        MappedFile file_data{path};
+        RefPtr<MappedFile> file_data{new MappedFile{path}};
         return buffer_manager.create_buffer(filename.str(), Buffer::Flags::File | flags,
-                                            file_data, file_data.st.st_mtim);
+                                            *file_data, file_data->st.st_mtim, file_data);
     }
     return buffer_manager.create_buffer(
         filename.str(), Buffer::Flags::File | Buffer::Flags::New,
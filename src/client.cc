@@ -66,6 +66,11 @@ Client::~Client()
                                               context().selections());
 }
 
+void Client::read_available_inputs()
+{
+    m_ui->read_available_keys();
+}
+
 bool Client::process_pending_inputs()
 {
     const bool debug_keys = (bool)(context().options()["debug"].get<DebugFlags>() & DebugFlags::Keys);
@@ -38,6 +38,9 @@ public:
     Client(Client&&) = delete;
 
     bool process_pending_inputs();
+    bool has_pending_inputs() const { return not m_pending_keys.empty(); }
+    // adds the keys already received to the pending inputs
+    void read_available_inputs();
 
     void menu_show(Vector<DisplayLine> choices, BufferCoord anchor, MenuStyle style);
     void menu_select(int selected);
@@ -360,6 +360,9 @@ TokenList parse(StringView line)
     return result;
 }
 
+// used by other files, optimized builds can inline every local use
+template TokenList parse<true>(StringView);
+
 template<typename Postprocess>
 String expand_impl(StringView str, const Context& context,
                    const ShellContext& shell_context,
@@ -24,6 +24,7 @@
 #include "register_manager.hh"
 #include "remote.hh"
 #include "shell_manager.hh"
+#include "slab_allocator.hh"
 #include "string.hh"
 #include "user_interface.hh"
 #include "window.hh"
@@ -1110,7 +1111,7 @@ const CommandDesc debug_cmd = {
     "debug",
     nullptr,
     "debug <command>: write some debug informations in the debug buffer\n"
-    "existing commands: info, buffers, options, memory, shared-strings, profile-hash-maps, faces",
+    "existing commands: info, buffers, options, memory, shared-strings, profile-hash-maps, faces, mappings, regex",
     ParameterDesc{{}, ParameterDesc::Flags::SwitchesOnlyAtStart, 1},
     CommandFlags::None,
     CommandHelper{},
@@ -1118,7 +1119,7 @@ const CommandDesc debug_cmd = {
         [](const Context& context, CompletionFlags flags,
            const String& prefix, ByteCount cursor_pos) -> Completions {
                auto c = {"info", "buffers", "options", "memory", "shared-strings",
-                         "profile-hash-maps", "faces", "mappings"};
+                         "profile-hash-maps", "faces", "mappings", "regex"};
                return { 0_byte, cursor_pos, complete(prefix, cursor_pos, c) };
     }),
     [](const ParametersParser& parser, Context& context, const ShellContext&)
@@ -1159,6 +1160,19 @@ const CommandDesc debug_cmd = {
             #if defined(__GLIBC__) || defined(__CYGWIN__)
             write_to_debug_buffer(format("  Malloced: {}", mallinfo().uordblks));
             #endif
+
+            size_t history = 0, spilled_history = 0;
+            for (auto& buffer : BufferManager::instance())
+            {
+                history += buffer->history_size();
+                spilled_history += buffer->spilled_history_size();
+            }
+            write_to_debug_buffer(format("  Undo history: {} (spilled: {})", history, spilled_history));
+            auto& compression = LineList::compression_stats();
+            write_to_debug_buffer(format("  Compressed lines: {} (compressions: {}, decompressions: {})",
+                                         domain_allocated_bytes[(int)MemoryDomain::CompressedLines],
+                                         compression.compressions, compression.decompressions));
+            StringData::allocator().write_debug_stats("String");
         }
         else if (parser[0] == "shared-strings")
         {
@@ -1189,6 +1203,15 @@ const CommandDesc debug_cmd = {
                                           keymaps.get_mapping(key, m).docstring));
             }
         }
+        else if (parser[0] == "regex")
+        {
+            RegexCache::instance().debug_stats();
+            write_to_debug_buffer("Regex VM stats:");
+            write_to_debug_buffer(format("  built: {}, reused: {}, saves allocated: {}",
+                                         regex_vm_stats.vms_built.load(),
+                                         regex_vm_stats.vms_reused.load(),
+                                         regex_vm_stats.saves_allocated.load()));
+        }
         else
             throw runtime_error(format("unknown debug command '{}'", parser[0]));
     }
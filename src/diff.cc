@@ -0,0 +1,207 @@
+#include "diff.hh"
+
+#include "text_scan.hh"
+
+#include <algorithm>
+
+namespace Kakoune
+{
+
+namespace
+{
+
+struct PatienceDiff
+{
+    ConstArrayView<int> a, b;
+    // per id occurence counts and last position in the range being diffed
+    Vector<int> count_a, count_b, pos_a;
+    Vector<Diff>& diffs;
+
+    struct Anchor { int pos_a, pos_b; };
+
+    // Longest sequence of unique common elements appearing in the same
+    // order in both ranges, found by patience sorting.
+    Vector<Anchor> find_anchors(int begA, int endA, int begB, int endB)
+    {
+        for (int i = begA; i < endA; ++i)
+        {
+            ++count_a[a[i]];
+            pos_a[a[i]] = i;
+        }
+        for (int i = begB; i < endB; ++i)
+            ++count_b[b[i]];
+
+        Vector<Anchor> candidates;
+        for (int i = begB; i < endB; ++i)
+        {
+            if (count_a[b[i]] == 1 and count_b[b[i]] == 1)
+                candidates.push_back({pos_a[b[i]], i});
+        }
+
+        for (int i = begA; i < endA; ++i)
+            count_a[a[i]] = 0;
+        for (int i = begB; i < endB; ++i)
+            count_b[b[i]] = 0;
+
+        // pile_tops[n] is the candidate ending the best sequence of length n+1
+        Vector<int> pile_tops;
+        Vector<int> previous(candidates.size(), -1);
+        for (int i = 0; i < (int)candidates.size(); ++i)
+        {
+            // candidates mostly come in order, extending the longest sequence
+            if (pile_tops.empty() or candidates[pile_tops.back()].pos_a < candidates[i].pos_a)
+            {
+                previous[i] = pile_tops.empty() ? -1 : pile_tops.back();
+                pile_tops.push_back(i);
+                continue;
+            }
+            auto it = std::lower_bound(pile_tops.begin(), pile_tops.end(), candidates[i].pos_a,
+                                       [&](int c, int pos) { return candidates[c].pos_a < pos; });
+            if (it != pile_tops.begin())
+                previous[i] = *(it-1);
+            if (it == pile_tops.end())
+                pile_tops.push_back(i);
+            else
+                *it = i;
+        }
+
+        Vector<Anchor> anchors;
+        for (int i = pile_tops.empty() ? -1 : pile_tops.back(); i != -1; i = previous[i])
+            anchors.push_back(candidates[i]);
+        std::reverse(anchors.begin(), anchors.end());
+        return anchors;
+    }
+
+    void diff(int begA, int endA, int begB, int endB)
+    {
+        int prefix_len = 0;
+        while (begA != endA and begB != endB and a[begA] == b[begB])
+             ++begA, ++begB, ++prefix_len;
+
+        int suffix_len = 0;
+        while (begA != endA and begB != endB and a[endA-1] == b[endB-1])
+            --endA, --endB, ++suffix_len;
+
+        append_diff(diffs, {Diff::Keep, prefix_len, 0});
+
+        const int lenA = endA - begA, lenB = endB - begB;
+        if (lenA == 0)
+            append_diff(diffs, {Diff::Add, lenB, begB});
+        else if (lenB == 0)
+            append_diff(diffs, {Diff::Remove, lenA, 0});
+        else
+        {
+            const auto anchors = find_anchors(begA, endA, begB, endB);
+            for (auto& anchor : anchors)
+            {
+                diff(begA, anchor.pos_a, begB, anchor.pos_b);
+                append_diff(diffs, {Diff::Keep, 1, 0});
+                begA = anchor.pos_a + 1;
+                begB = anchor.pos_b + 1;
+            }
+            if (not anchors.empty())
+                diff(begA, endA, begB, endB);
+            else
+                myers_diff(begA, endA, begB, endB);
+        }
+
+        append_diff(diffs, {Diff::Keep, suffix_len, 0});
+    }
+
+    void myers_diff(int begA, int endA, int begB, int endB)
+    {
+        const int lenA = endA - begA, lenB = endB - begB;
+        const int max = 2 * (lenA + lenB) + 1;
+        Vector<int> data(2*max);
+        constexpr int cost_limit = 1000;
+        find_diff_rec(a.begin(), begA, endA, b.begin(), begB, endB,
+                      &data[lenA+lenB], &data[max + lenA+lenB], cost_limit,
+                      std::equal_to<>{}, diffs);
+    }
+};
+
+}
+
+Vector<Diff> find_diff_by_ids(ConstArrayView<int> a, ConstArrayView<int> b)
+{
+    int id_count = 0;
+    for (auto id : a)
+        id_count = std::max(id_count, id + 1);
+    for (auto id : b)
+        id_count = std::max(id_count, id + 1);
+
+    Vector<Diff> diffs;
+    PatienceDiff patience{a, b, Vector<int>(id_count, 0), Vector<int>(id_count, 0),
+                          Vector<int>(id_count, 0), diffs};
+    patience.diff(0, (int)a.size(), 0, (int)b.size());
+    return diffs;
+}
+
+static Vector<StringView> split_lines(StringView text)
+{
+    Vector<StringView> lines;
+    for (auto it = text.begin(), end = text.end(); it != end; )
+    {
+        auto eol = find_byte(it, end, '\n');
+        if (eol != end)
+            ++eol;
+        lines.emplace_back(it, eol);
+        it = eol;
+    }
+    return lines;
+}
+
+Vector<Diff> find_text_diff(StringView a, StringView b, int max_bytewise_len)
+{
+    if ((int)a.length() + (int)b.length() <= max_bytewise_len)
+        return find_diff(a.begin(), (int)a.length(), b.begin(), (int)b.length());
+
+    const auto lines_a = split_lines(a);
+    const auto lines_b = split_lines(b);
+    const auto line_diffs = find_diff_hashed(lines_a.begin(), (int)lines_a.size(),
+                                             lines_b.begin(), (int)lines_b.size());
+
+    Vector<Diff> diffs;
+    int line_a = 0, line_b = 0;
+    int pos_a = 0, pos_b = 0;
+    auto line_pos = [](const Vector<StringView>& lines, StringView text, int line) {
+        return line < lines.size() ? (int)(lines[line].begin() - text.begin()) : (int)text.length();
+    };
+
+    for (auto it = line_diffs.begin(), end = line_diffs.end(); it != end; )
+    {
+        if (it->mode == Diff::Keep)
+        {
+            line_a += it->len;
+            line_b += it->len;
+            const int len = line_pos(lines_a, a, line_a) - pos_a;
+            append_diff(diffs, {Diff::Keep, len, 0});
+            pos_a += len;
+            pos_b += len;
+            ++it;
+            continue;
+        }
+
+        // gather changed lines up to the next kept ones
+        for (; it != end and it->mode != Diff::Keep; ++it)
+            (it->mode == Diff::Add ? line_b : line_a) += it->len;
+
+        const int len_a = line_pos(lines_a, a, line_a) - pos_a;
+        const int len_b = line_pos(lines_b, b, line_b) - pos_b;
+        if (len_a != 0 and len_b != 0 and len_a + len_b <= max_bytewise_len)
+        {
+            for (auto& diff : find_diff(a.begin() + pos_a, len_a, b.begin() + pos_b, len_b))
+                append_diff(diffs, {diff.mode, diff.len, diff.mode == Diff::Add ? diff.posB + pos_b : 0});
+        }
+        else
+        {
+            append_diff(diffs, {Diff::Remove, len_a, 0});
+            append_diff(diffs, {Diff::Add, len_b, pos_b});
+        }
+        pos_a += len_a;
+        pos_b += len_b;
+    }
+    return diffs;
+}
+
+}
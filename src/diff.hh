@@ -6,8 +6,11 @@
 // (http://xmailserver.org/diff2.pdf)
 
 #include "array_view.hh"
+#include "hash.hh"
+#include "string.hh"
 #include "vector.hh"
 
+#include <cstdint>
 #include <functional>
 #include <iterator>
 
@@ -180,6 +183,83 @@ Vector<Diff> find_diff(Iterator a, int N, Iterator b, int M, Equal eq = Equal{})
     return diffs;
 }
 
+// Diffs sequences of element ids, using unique common elements as anchors
+// (patience diff) and find_diff_rec between them.
+Vector<Diff> find_diff_by_ids(ConstArrayView<int> a, ConstArrayView<int> b);
+
+// Diff meant for long sequences of elements, such as lines, that are
+// expensive to compare: the common prefix and suffix are skipped, then each
+// remaining element is hashed once to an id and diffed by find_diff_by_ids.
+template<typename Iterator>
+Vector<Diff> find_diff_hashed(Iterator a, int N, Iterator b, int M)
+{
+    int prefix_len = 0;
+    while (prefix_len != N and prefix_len != M and a[prefix_len] == b[prefix_len])
+        ++prefix_len;
+
+    int suffix_len = 0;
+    while (prefix_len + suffix_len != N and prefix_len + suffix_len != M and
+           a[N-1-suffix_len] == b[M-1-suffix_len])
+        ++suffix_len;
+
+    const int lenA = N - prefix_len - suffix_len;
+    const int count = lenA + M - prefix_len - suffix_len;
+    auto element = [&](int i) -> decltype(*a) {
+        return i < lenA ? a[prefix_len + i] : b[prefix_len + i - lenA];
+    };
+
+    Vector<size_t> hashes(count);
+    for (int i = 0; i < count; ++i)
+        hashes[i] = hash_value(element(i));
+
+    // open addressing table from hashes to ids, compact to limit cache misses
+    struct Entry { uint32_t hash; int id; };
+    size_t mask = 1;
+    while (mask < (size_t)count + count / 2)
+        mask = mask * 2 + 1;
+    Vector<Entry> table(mask + 1, Entry{0, -1});
+
+    constexpr int prefetch_distance = 16;
+    Vector<int> ids(count);
+    Vector<int> id_elements;
+    for (int i = 0; i < count; ++i)
+    {
+        if (i + prefetch_distance < count)
+            __builtin_prefetch(&table[hashes[i + prefetch_distance] & mask]);
+
+        const uint32_t hash = (uint32_t)hashes[i];
+        for (size_t slot = hashes[i] & mask; ; slot = (slot + 1) & mask)
+        {
+            auto& entry = table[slot];
+            if (entry.id == -1)
+            {
+                entry = {hash, (int)id_elements.size()};
+                ids[i] = entry.id;
+                id_elements.push_back(i);
+                break;
+            }
+            if (entry.hash == hash and element(id_elements[entry.id]) == element(i))
+            {
+                ids[i] = entry.id;
+                break;
+            }
+        }
+    }
+
+    Vector<Diff> diffs;
+    append_diff(diffs, {Diff::Keep, prefix_len, 0});
+    for (auto& diff : find_diff_by_ids({ids.data(), ids.data() + lenA},
+                                       {ids.data() + lenA, ids.data() + count}))
+        append_diff(diffs, {diff.mode, diff.len, diff.mode == Diff::Add ? diff.posB + prefix_len : 0});
+    append_diff(diffs, {Diff::Keep, suffix_len, 0});
+    return diffs;
+}
+
+// Byte level diff of texts, long ones are diffed linewise first using
+// find_diff_hashed, changed lines being then diffed bytewise when they are
+// small enough. Texts up to max_bytewise_len are diffed bytewise directly.
+Vector<Diff> find_text_diff(StringView a, StringView b, int max_bytewise_len = 64 * 1024);
+
 }
 
 #endif // diff_hh_INCLUDED
@@ -69,7 +69,7 @@ EventManager::~EventManager()
     kak_assert(m_timers.empty());
 }
 
-void EventManager::handle_next_events(EventMode mode, sigset_t* sigmask)
+void EventManager::handle_next_events(EventMode mode, sigset_t* sigmask, bool block)
 {
     int max_fd = 0;
     fd_set rfds, wfds, efds;
@@ -90,9 +90,9 @@ void EventManager::handle_next_events(EventMode mode, sigset_t* sigmask)
         }
     }
 
-    bool with_timeout = false;
+    bool with_timeout = not block;
     timespec ts{};
-    if (not m_timers.empty())
+    if (block and not m_timers.empty())
     {
         auto next_date = (*std::min_element(
             m_timers.begin(), m_timers.end(), [](Timer* lhs, Timer* rhs) {
@@ -147,6 +147,8 @@ void EventManager::force_signal(int fd)
     FD_SET(fd, &m_forced_fd);
 }
 
+volatile sig_atomic_t sigint_received = 0;
+
 SignalHandler set_signal_handler(int signum, SignalHandler handler)
 {
     struct sigaction new_action, old_action;
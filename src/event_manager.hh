@@ -86,7 +86,9 @@ public:
     EventManager();
     ~EventManager();
 
-    void handle_next_events(EventMode mode, sigset_t* sigmask = nullptr);
+    // waits for the next events unless block is false, in which case only
+    // the already pending ones are handled
+    void handle_next_events(EventMode mode, sigset_t* sigmask = nullptr, bool block = true);
 
     // force the watchers associated with fd to be executed
     // on next handle_next_events call.
@@ -106,6 +108,10 @@ using SignalHandler = void(*)(int);
 
 SignalHandler set_signal_handler(int signum, SignalHandler handler);
 
+// Set by the SIGINT handler, <c-c> sends that signal to the process group
+// of the editor. Operations that can be interrupted reset it when starting.
+extern volatile sig_atomic_t sigint_received;
+
 }
 
 #endif // event_manager_hh_INCLUDED
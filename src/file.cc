@@ -2,11 +2,13 @@
 
 #include "assert.hh"
 #include "buffer.hh"
+#include "event_manager.hh"
 #include "exception.hh"
 #include "flags.hh"
 #include "ranked_match.hh"
 #include "regex.hh"
 #include "string.hh"
+#include "text_scan.hh"
 #include "unicode.hh"
 
 #include <cerrno>
@@ -155,21 +157,9 @@ String read_fd(int fd, bool text)
         if (size == -1)
             throw file_access_error{fd, strerror(errno)};
 
-        if  (text)
-        {
-            ssize_t beg = 0;
-            for (ssize_t pos = 0; pos < size; ++pos)
-            {
-                if (buf[pos] == '\r')
-                {
-                   content += StringView{buf + beg, buf + pos};
-                   beg = pos + 1;
-                }
-            }
-            content += StringView{buf + beg, buf + size};
-        }
-        else
-            content += StringView{buf, buf + size};
+        if (text)
+            size = remove_byte(buf, buf + size, buf, '\r') - buf;
+        content += StringView{buf, buf + size};
     }
     return content;
 }
@@ -208,6 +198,7 @@ MappedFile::MappedFile(StringView filename)
 
 MappedFile::~MappedFile()
 {
+    lease_watcher.reset();
     if (fd != -1)
     {
         if (data != nullptr)
@@ -221,6 +212,39 @@ MappedFile::operator StringView() const
     return { data, (int)st.st_size };
 }
 
+bool MappedFile::watch_modifications(std::function<bool ()> on_modification)
+{
+#if defined(F_SETLEASE) && defined(F_SETSIG)
+    // The kernel notifies read lease holders with a signal and delays
+    // writers until the lease is released (or for lease-break-time seconds)
+    static const bool handler_installed = [] {
+        struct sigaction action{};
+        sigemptyset(&action.sa_mask);
+        action.sa_sigaction = [](int, siginfo_t* info, void*) {
+            if (EventManager::has_instance())
+                EventManager::instance().force_signal(info->si_fd);
+        };
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        return sigaction(SIGIO, &action, nullptr) == 0;
+    }();
+
+    if (not handler_installed or not EventManager::has_instance() or
+        fcntl(fd, F_SETSIG, SIGIO) == -1 or fcntl(fd, F_SETLEASE, F_RDLCK) == -1)
+        return false;
+
+    lease_watcher.reset(new FDWatcher{fd, FdEvents::None,
+        [this, on_modification = std::move(on_modification)](FDWatcher& watcher, FdEvents, EventMode) {
+            watcher.disable();
+            // let the writer go on without waiting for our release
+            if (on_modification())
+                fcntl(fd, F_SETLEASE, F_UNLCK);
+        }});
+    return true;
+#else
+    return false;
+#endif
+}
+
 bool file_exists(StringView filename)
 {
     struct stat st;
@@ -286,6 +310,15 @@ void write_buffer_to_file(Buffer& buffer, StringView filename, bool force)
             throw runtime_error("couldn't restore file permissions");
     });
 
+    // Buffer lines might still be read from the file we are about to truncate
+    struct stat target;
+    if (auto* mapped = buffer.mapped_file())
+    {
+        if (::stat(zfilename, &target) == 0 and target.st_dev == mapped->st.st_dev and
+            target.st_ino == mapped->st.st_ino)
+            buffer.materialize_lines();
+    }
+
     int fd = open(zfilename, O_CREAT | O_WRONLY | O_TRUNC, 0644);
     if (fd == -1)
         throw file_access_error(filename, strerror(errno));
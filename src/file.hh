@@ -3,12 +3,16 @@
 
 #include "array_view.hh"
 #include "meta.hh"
+#include "ref_ptr.hh"
 #include "units.hh"
 #include "vector.hh"
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <functional>
+#include <memory>
+
 namespace Kakoune
 {
 
@@ -16,6 +20,7 @@ class Buffer;
 class String;
 class StringView;
 class Regex;
+class FDWatcher;
 
 using CandidateList = Vector<String, MemoryDomain::Completion>;
 
@@ -37,16 +42,27 @@ String read_fd(int fd, bool text = false);
 String read_file(StringView filename, bool text = false);
 void write(int fd, StringView data);
 
-struct MappedFile
+struct MappedFile : RefCountable
 {
     MappedFile(StringView filename);
     ~MappedFile();
 
     operator StringView() const;
 
+    // Calls on_modification before the file gets opened for writing or
+    // truncated, the mapped data stays unchanged until the MappedFile is
+    // released, or until on_modification returns true to tell that it will
+    // not be read anymore. Returns false if the file system does not
+    // support that.
+    //
+    // on_modification runs in any event mode, possibly while the mapped data
+    // is being read. It must not release the MappedFile itself.
+    bool watch_modifications(std::function<bool ()> on_modification);
+
     int fd;
     const char* data;
     struct stat st {};
+    std::unique_ptr<FDWatcher> lease_watcher;
 };
 
 void write_buffer_to_file(Buffer& buffer, StringView filename, bool force = false);
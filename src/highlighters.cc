@@ -1210,6 +1210,13 @@ static void update_line_specs_ifn(const Buffer& buffer, LineAndSpecList& line_fl
     if (line_flags.prefix == buffer.timestamp())
         return;
 
+    // line numbers cannot be updated anymore, keep them as is
+    if (buffer.changes_discarded(line_flags.prefix))
+    {
+        line_flags.prefix = buffer.timestamp();
+        return;
+    }
+
     auto& lines = line_flags.list;
 
     auto modifs = compute_line_modifications(buffer, line_flags.prefix);
@@ -1387,6 +1394,14 @@ static void update_ranges_ifn(const Buffer& buffer, RangeAndStringList& range_an
     if (range_and_faces.prefix == buffer.timestamp())
         return;
 
+    // ranges cannot be updated anymore, keep them as is, invalid ones are
+    // ignored by the highlighters
+    if (buffer.changes_discarded(range_and_faces.prefix))
+    {
+        range_and_faces.prefix = buffer.timestamp();
+        return;
+    }
+
     auto changes = buffer.changes_since(range_and_faces.prefix);
     for (auto change_it = changes.begin(); change_it != changes.end(); )
     {
@@ -1925,7 +1940,7 @@ private:
         const size_t buf_timestamp = buffer.timestamp();
         if (cache.timestamp != buf_timestamp)
         {
-            if (cache.timestamp == 0)
+            if (cache.timestamp == 0 or buffer.changes_discarded(cache.timestamp))
             {
                 cache.matches.resize(m_regions.size());
                 for (size_t i = 0; i < m_regions.size(); ++i)
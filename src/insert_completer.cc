@@ -275,6 +275,8 @@ InsertCompletion complete_option(const SelectionList& sels,
             end = buffer.advance(coord, len);
         }
         size_t timestamp = (size_t)str_to_int({match[4].first, match[4].second});
+        if (buffer.changes_discarded(timestamp))
+            return {};
         auto changes = buffer.changes_since(timestamp);
         if (contains_that(changes, [&](const Buffer::Change& change)
                           { return change.begin < coord; }))
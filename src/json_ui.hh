@@ -44,6 +44,7 @@ public:
 
     DisplayCoord dimensions() override;
     void set_on_key(OnKeyCallback callback) override;
+    void read_available_keys() override { parse_requests(EventMode::Urgent); }
     void set_ui_options(const Options& options) override;
 
 private:
@@ -0,0 +1,623 @@
+#include "line_list.hh"
+
+#include "lz_codec.hh"
+#include "string_utils.hh"
+#include "text_scan.hh"
+#include "unit_tests.hh"
+
+#include <algorithm>
+
+namespace Kakoune
+{
+
+LineList::CompressionStats LineList::ms_compression_stats;
+
+static size_t count_bytes(BufferLines::const_iterator begin, BufferLines::const_iterator end)
+{
+    size_t bytes = 0;
+    for (auto it = begin; it != end; ++it)
+        bytes += (int)(*it)->strview().length();
+    return bytes;
+}
+
+static void intern_lines(BufferLines::iterator begin, BufferLines::iterator end)
+{
+    auto& registry = StringRegistry::instance();
+    registry.reserve(end - begin);
+    for (auto it = begin; it != end; ++it)
+        *it = registry.intern(std::move(*it));
+}
+
+void LineList::assign(BufferLines lines)
+{
+    if (m_interned)
+        intern_lines(lines.begin(), lines.end());
+    replace_chunks(0, (int)m_chunks.size(), std::move(lines));
+    m_mapping.reset();
+}
+
+void LineList::assign_mapped(StringView data, RefPtr<MappedFile> mapping)
+{
+    kak_assert(data.empty() or data.back() == '\n');
+    assign({});
+
+    const int target_size = m_max_chunk_size / 2;
+    const char* pos = data.begin();
+    while (pos != data.end())
+    {
+        RefPtr<Chunk> chunk{new Chunk};
+        chunk->mapped = pos;
+        chunk->ends.reserve(target_size);
+        while (pos != data.end() and (int)chunk->ends.size() < target_size)
+        {
+            pos = find_byte(pos, data.end(), '\n') + 1;
+            chunk->ends.push_back((uint32_t)(pos - chunk->mapped));
+        }
+        chunk->bytes = chunk->ends.back();
+        m_size += chunk->size();
+        m_chunks.push_back(std::move(chunk));
+    }
+
+    m_mapping = std::move(mapping);
+    rebuild_index();
+}
+
+RefPtr<MappedFile> LineList::materialize()
+{
+    for (int chunk = 0; chunk < (int)m_chunks.size(); ++chunk)
+    {
+        if (m_chunks[chunk]->mapped)
+            materialized(chunk);
+    }
+    return std::move(m_mapping);
+}
+
+void LineList::set_interned(bool interned)
+{
+    if (interned and not m_interned)
+    {
+        for (int i = 0; i < (int)m_chunks.size(); ++i)
+        {
+            if (not m_chunks[i]->has_lines())
+                continue;
+            auto& chunk = materialized(i);
+            intern_lines(chunk.lines.begin(), chunk.lines.end());
+        }
+    }
+    m_interned = interned;
+}
+
+size_t LineList::byte_offset(LineCount line) const
+{
+    if ((int)line == m_size)
+        return m_byte_count;
+    auto loc = locate((int)line);
+    return chunk_byte_start(loc.chunk) +
+           (loc.offset == 0 ? 0 : m_chunks[loc.chunk]->line_ends()[loc.offset-1]);
+}
+
+BufferCoord LineList::byte_coord(size_t offset) const
+{
+    kak_assert(offset < m_byte_count);
+    int chunk = 0;
+    size_t remaining = offset;
+    for (int step = m_index_step; step > 0; step >>= 1)
+    {
+        if (chunk + step < (int)m_byte_index.size() and m_byte_index[chunk + step] <= remaining)
+        {
+            chunk += step;
+            remaining -= m_byte_index[chunk];
+        }
+    }
+
+    auto& ends = m_chunks[chunk]->line_ends();
+    const int index = (int)(std::upper_bound(ends.begin(), ends.end(), (uint32_t)remaining) - ends.begin());
+    kak_assert(index < (int)ends.size());
+    return {chunk_start(chunk) + index, (int)(remaining - (index == 0 ? 0 : ends[index-1]))};
+}
+
+void LineList::set(LineCount line, StringDataPtr content)
+{
+    auto loc = locate((int)line);
+    auto& chunk = materialized(loc.chunk);
+    auto& storage = chunk.lines[loc.offset];
+    if (m_interned)
+        content = StringRegistry::instance().intern(std::move(content));
+    const ssize_t delta = (int)content->strview().length() - (int)storage->strview().length();
+    storage = std::move(content);
+    chunk.ends.clear();
+    update_byte_index(loc.chunk, delta);
+}
+
+void LineList::insert(LineCount line, BufferLines::iterator begin, BufferLines::iterator end)
+{
+    const int count = (int)(end - begin);
+    if (count == 0)
+        return;
+
+    if (m_chunks.empty())
+        return assign(BufferLines{std::make_move_iterator(begin),
+                                  std::make_move_iterator(end)});
+
+    if (m_interned)
+        intern_lines(begin, end);
+
+    auto loc = locate_insert_pos((int)line);
+    auto& chunk = materialized(loc.chunk);
+    auto& lines = chunk.lines;
+    if ((int)lines.size() + count <= m_max_chunk_size)
+    {
+        const size_t bytes = count_bytes(begin, end);
+        lines.insert(lines.begin() + loc.offset,
+                     std::make_move_iterator(begin), std::make_move_iterator(end));
+        chunk.ends.clear();
+        m_size += count;
+        update_index(loc.chunk, count);
+        update_byte_index(loc.chunk, bytes);
+        return;
+    }
+
+    BufferLines merged;
+    merged.reserve(lines.size() + count);
+    std::move(lines.begin(), lines.begin() + loc.offset, std::back_inserter(merged));
+    std::move(begin, end, std::back_inserter(merged));
+    std::move(lines.begin() + loc.offset, lines.end(), std::back_inserter(merged));
+    replace_chunks(loc.chunk, loc.chunk + 1, std::move(merged));
+}
+
+void LineList::erase(LineCount begin_line, LineCount end_line)
+{
+    const int begin = (int)begin_line, end = (int)end_line;
+    kak_assert(begin <= end and end <= m_size);
+    if (begin == end)
+        return;
+
+    const auto first = locate(begin);
+    const auto last = locate_insert_pos(end);
+    m_size -= end - begin;
+
+    auto& first_chunk = materialized(first.chunk);
+    auto& first_lines = first_chunk.lines;
+    first_chunk.ends.clear();
+    if (first.chunk == last.chunk)
+    {
+        const size_t bytes = count_bytes(first_lines.begin() + first.offset,
+                                         first_lines.begin() + last.offset);
+        first_lines.erase(first_lines.begin() + first.offset,
+                          first_lines.begin() + last.offset);
+        if ((int)first_lines.size() >= min_chunk_size())
+        {
+            update_index(first.chunk, begin - end);
+            update_byte_index(first.chunk, -(ssize_t)bytes);
+        }
+        else
+        {
+            first_chunk.bytes -= bytes;
+            rebalance(first.chunk);
+        }
+        return;
+    }
+
+    first_chunk.bytes -= count_bytes(first_lines.begin() + first.offset, first_lines.end());
+    first_lines.erase(first_lines.begin() + first.offset, first_lines.end());
+    auto& last_chunk = materialized(last.chunk);
+    auto& last_lines = last_chunk.lines;
+    last_chunk.ends.clear();
+    last_chunk.bytes -= count_bytes(last_lines.begin(), last_lines.begin() + last.offset);
+    last_lines.erase(last_lines.begin(), last_lines.begin() + last.offset);
+    m_chunks.erase(m_chunks.begin() + first.chunk + 1, m_chunks.begin() + last.chunk);
+    rebalance(first.chunk);
+}
+
+LineList::Location LineList::locate_slow(int line) const
+{
+    // Sequential accesses usually reach one of the neighbouring chunks
+    const int next = m_cache_chunk + 1;
+    const int next_start = m_cache_start + chunk_size(m_cache_chunk);
+    if (next < (int)m_chunks.size() and line >= next_start and
+        line < next_start + chunk_size(next))
+    {
+        m_cache_chunk = next;
+        m_cache_start = next_start;
+        return {next, line - next_start};
+    }
+
+    const int prev = m_cache_chunk - 1;
+    if (prev >= 0 and line < m_cache_start and
+        line >= m_cache_start - chunk_size(prev))
+    {
+        m_cache_chunk = prev;
+        m_cache_start -= chunk_size(prev);
+        return {prev, line - m_cache_start};
+    }
+
+    int chunk = 0, remaining = line;
+    for (int step = m_index_step; step > 0; step >>= 1)
+    {
+        if (chunk + step < (int)m_index.size() and m_index[chunk + step] <= remaining)
+        {
+            chunk += step;
+            remaining -= m_index[chunk];
+        }
+    }
+    kak_assert(chunk < (int)m_chunks.size() and remaining < chunk_size(chunk));
+
+    m_cache_chunk = chunk;
+    m_cache_start = line - remaining;
+    return {chunk, remaining};
+}
+
+LineList::Location LineList::locate_insert_pos(int line) const
+{
+    if (line == m_size)
+        return {(int)m_chunks.size() - 1, chunk_size((int)m_chunks.size() - 1)};
+    return locate(line);
+}
+
+LineList::Chunk& LineList::materialized(int index) const
+{
+    // Materializing a chunk does not change the lines it contains
+    auto& slot = const_cast<RefPtr<Chunk>&>(m_chunks[index]);
+    if (slot->refcount > 1)
+        slot = RefPtr<Chunk>{new Chunk{*slot}};
+
+    auto& chunk = *slot;
+    if (not chunk.has_lines())
+    {
+        const int count = chunk.size();
+        BufferLines lines;
+        lines.reserve(count);
+        for (int i = 0; i < count; ++i)
+            lines.push_back(m_interned ? intern(chunk.line(i))
+                                       : StringData::create(chunk.line(i)));
+        // line ends are still valid
+        chunk.lines = std::move(lines);
+        chunk.mapped = nullptr;
+        chunk.packed = {};
+        chunk.unpacked = {};
+    }
+    chunk.used = true;
+    return chunk;
+}
+
+void LineList::compress_cold_chunks()
+{
+    for (auto& chunk : m_chunks)
+    {
+        if (chunk->used)
+            chunk->used = false;
+        else if (not chunk->unpacked.empty())
+            chunk->unpacked = {};
+        // mapped lines do not use memory of their own, and shared chunks
+        // cannot be modified
+        else if (chunk->has_lines() and chunk->bytes != 0 and chunk->refcount == 1)
+            chunk->pack();
+    }
+}
+
+void LineList::Chunk::pack()
+{
+    kak_assert(has_lines());
+    line_ends();
+    Vector<char, MemoryDomain::BufferContent> data;
+    data.reserve(bytes);
+    for (auto& line : lines)
+        data.insert(data.end(), line->strview().begin(), line->strview().end());
+
+    Vector<char, MemoryDomain::CompressedLines> compressed(lz_compress_bound(bytes));
+    compressed.resize(lz_compress(data.data(), bytes, compressed.data()));
+    packed.assign(compressed.begin(), compressed.end());
+    lines = {};
+    ++ms_compression_stats.compressions;
+}
+
+void LineList::Chunk::unpack() const
+{
+    kak_assert(not packed.empty() and unpacked.empty());
+    unpacked.resize(bytes);
+    lz_decompress(packed.data(), packed.size(), unpacked.data(), bytes);
+    ++ms_compression_stats.decompressions;
+}
+
+const Vector<uint32_t, MemoryDomain::BufferContent>& LineList::Chunk::line_ends() const
+{
+    if (ends.empty())
+    {
+        ends.reserve(lines.size());
+        uint32_t offset = 0;
+        for (auto& line : lines)
+            ends.push_back(offset += (int)line->strview().length());
+    }
+    return ends;
+}
+
+int LineList::chunk_start(int chunk) const
+{
+    int res = 0;
+    for (int i = chunk; i > 0; i -= i & -i)
+        res += m_index[i];
+    return res;
+}
+
+size_t LineList::chunk_byte_start(int chunk) const
+{
+    size_t res = 0;
+    for (int i = chunk; i > 0; i -= i & -i)
+        res += m_byte_index[i];
+    return res;
+}
+
+void LineList::update_index(int chunk, int delta)
+{
+    for (int i = chunk + 1; i < (int)m_index.size(); i += i & -i)
+        m_index[i] += delta;
+    if (m_cache_chunk > chunk)
+        m_cache_start += delta;
+}
+
+void LineList::update_byte_index(int chunk, ssize_t delta)
+{
+    m_chunks[chunk]->bytes += delta;
+    for (int i = chunk + 1; i < (int)m_byte_index.size(); i += i & -i)
+        m_byte_index[i] += delta;
+    m_byte_count += delta;
+}
+
+void LineList::rebuild_index()
+{
+    const int count = (int)m_chunks.size();
+    m_index.assign(count + 1, 0);
+    m_byte_index.assign(count + 1, 0);
+    m_byte_count = 0;
+    for (int i = 1; i <= count; ++i)
+    {
+        m_index[i] += chunk_size(i-1);
+        m_byte_index[i] += m_chunks[i-1]->bytes;
+        m_byte_count += m_chunks[i-1]->bytes;
+        const int parent = i + (i & -i);
+        if (parent <= count)
+        {
+            m_index[parent] += m_index[i];
+            m_byte_index[parent] += m_byte_index[i];
+        }
+    }
+
+    m_index_step = 0;
+    while (count != 0 and m_index_step * 2 <= count)
+        m_index_step = m_index_step ? m_index_step * 2 : 1;
+
+    m_cache_chunk = 0;
+    m_cache_start = 0;
+}
+
+void LineList::replace_chunks(int first, int last, BufferLines lines)
+{
+    int removed = 0;
+    for (int chunk = first; chunk < last; ++chunk)
+        removed += chunk_size(chunk);
+
+    // Leave room in new chunks so that following inserts do not split them right away
+    const int target_size = m_max_chunk_size / 2;
+    const int count = (int)lines.size();
+    const int chunk_count = (count + target_size - 1) / target_size;
+
+    Vector<RefPtr<Chunk>, MemoryDomain::BufferContent> new_chunks;
+    new_chunks.reserve(chunk_count);
+    if (count <= m_max_chunk_size)
+    {
+        if (count != 0)
+        {
+            new_chunks.emplace_back(new Chunk);
+            new_chunks.back()->bytes = count_bytes(lines.begin(), lines.end());
+            new_chunks.back()->lines = std::move(lines);
+        }
+    }
+    else for (int i = 0; i < chunk_count; ++i)
+    {
+        auto begin = lines.begin() + (int)((size_t)count * i / chunk_count);
+        auto end = lines.begin() + (int)((size_t)count * (i+1) / chunk_count);
+        new_chunks.emplace_back(new Chunk);
+        new_chunks.back()->bytes = count_bytes(begin, end);
+        new_chunks.back()->lines = BufferLines{std::make_move_iterator(begin),
+                                              std::make_move_iterator(end)};
+    }
+
+    m_chunks.erase(m_chunks.begin() + first, m_chunks.begin() + last);
+    m_chunks.insert(m_chunks.begin() + first,
+                    std::make_move_iterator(new_chunks.begin()),
+                    std::make_move_iterator(new_chunks.end()));
+    m_size += count - removed;
+    rebuild_index();
+}
+
+void LineList::rebalance(int chunk)
+{
+    auto begin = m_chunks.begin() + chunk;
+    auto end = m_chunks.begin() + std::min(chunk + 2, (int)m_chunks.size());
+    m_chunks.erase(std::remove_if(begin, end, [](const RefPtr<Chunk>& c) { return c->size() == 0; }), end);
+
+    auto merge_into_previous = [this](int chunk) {
+        if (m_chunks[chunk-1]->has_lines() and m_chunks[chunk]->has_lines() and
+            (chunk_size(chunk-1) < min_chunk_size() or chunk_size(chunk) < min_chunk_size()) and
+            chunk_size(chunk-1) + chunk_size(chunk) <= m_max_chunk_size)
+        {
+            auto& prev = materialized(chunk-1);
+            auto& lines = materialized(chunk).lines;
+            prev.lines.insert(prev.lines.end(), std::make_move_iterator(lines.begin()),
+                              std::make_move_iterator(lines.end()));
+            prev.ends.clear();
+            prev.bytes += m_chunks[chunk]->bytes;
+            m_chunks.erase(m_chunks.begin() + chunk);
+        }
+    };
+
+    chunk = std::min(chunk, (int)m_chunks.size() - 1);
+    if (chunk + 1 < (int)m_chunks.size())
+        merge_into_previous(chunk + 1);
+    if (chunk > 0)
+        merge_into_previous(chunk);
+
+    rebuild_index();
+}
+
+void LineList::check_invariant() const
+{
+#ifdef KAK_DEBUG
+    int size = 0;
+    size_t bytes = 0;
+    for (int chunk = 0; chunk < (int)m_chunks.size(); ++chunk)
+    {
+        auto& c = *m_chunks[chunk];
+        kak_assert(c.size() != 0);
+        kak_assert(chunk_start(chunk) == size);
+        kak_assert(chunk_byte_start(chunk) == bytes);
+        size_t chunk_bytes = 0;
+        for (int i = 0; i < c.size(); ++i)
+            chunk_bytes += (int)c.line(i).length();
+        kak_assert(c.bytes == chunk_bytes);
+        kak_assert(c.ends.empty() or c.ends.back() == chunk_bytes);
+        size += c.size();
+        bytes += chunk_bytes;
+    }
+    kak_assert(size == m_size);
+    kak_assert(bytes == m_byte_count);
+#endif
+}
+
+UnitTest test_line_list{[]()
+{
+    auto make_lines = [](int begin, int end) {
+        BufferLines lines;
+        for (int i = begin; i < end; ++i)
+            lines.push_back(StringData::create({format("{}\n", i)}));
+        return lines;
+    };
+    auto check = [](const LineList& list, const Vector<int>& expected) {
+        list.check_invariant();
+        kak_assert(list.size() == (int)expected.size());
+        for (int i = 0; i < (int)expected.size(); ++i)
+            kak_assert(list[LineCount{i}] == format("{}\n", expected[i]));
+        int i = 0;
+        for (auto line : list)
+            kak_assert(line == format("{}\n", expected[i++]));
+
+        size_t offset = 0;
+        for (int i = 0; i < (int)expected.size(); ++i)
+        {
+            const int len = (int)list[LineCount{i}].length();
+            kak_assert(list.byte_offset(LineCount{i}) == offset);
+            kak_assert(list.byte_coord(offset) == BufferCoord(i, 0));
+            kak_assert(list.byte_coord(offset + len - 1) == BufferCoord(i, len - 1));
+            offset += len;
+        }
+        kak_assert(list.byte_offset(LineCount{list.size()}) == offset and
+                   list.byte_count() == offset);
+    };
+
+    Vector<int> expected;
+    for (int i = 0; i < 40; ++i)
+        expected.push_back(i);
+    // chunks of at most 16 lines, filled with 8 lines
+    LineList list{16};
+    list.assign(make_lines(0, 40));
+    check(list, expected);
+
+    // insert enough lines in a chunk to split it
+    auto lines = make_lines(100, 120);
+    list.insert(10_line, lines.begin(), lines.end());
+    for (int i = 0; i < 20; ++i)
+        expected.insert(expected.begin() + 10 + i, 100 + i);
+    check(list, expected);
+
+    lines = make_lines(200, 203);
+    list.insert(LineCount{list.size()}, lines.begin(), lines.end());
+    expected.insert(expected.end(), {200, 201, 202});
+    check(list, expected);
+
+    // erase inside a chunk, then across chunks
+    list.erase(2_line, 5_line);
+    expected.erase(expected.begin() + 2, expected.begin() + 5);
+    check(list, expected);
+
+    list.erase(12_line, 40_line);
+    expected.erase(expected.begin() + 12, expected.begin() + 40);
+    check(list, expected);
+
+    list.set(3_line, StringData::create({"42\n"}));
+    expected[3] = 42;
+    check(list, expected);
+
+    list.erase(0_line, LineCount{list.size()});
+    kak_assert(list.empty());
+    lines = make_lines(0, 1);
+    list.insert(0_line, lines.begin(), lines.end());
+    check(list, {0});
+
+    // mapped lines are only copied when their chunk is modified
+    String data;
+    expected.clear();
+    for (int i = 0; i < 50; ++i)
+    {
+        data += format("{}\n", i);
+        expected.push_back(i);
+    }
+    list.assign_mapped(data, {});
+    check(list, expected);
+
+    list.erase(10_line, 20_line);
+    expected.erase(expected.begin() + 10, expected.begin() + 20);
+    lines = make_lines(100, 102);
+    list.insert(30_line, lines.begin(), lines.end());
+    expected.insert(expected.begin() + 30, {100, 101});
+    kak_assert(list.get_storage(5_line)->strview() == "5\n");
+    check(list, expected);
+
+    list.materialize();
+    data = String{};
+    check(list, expected);
+
+    // interned lines share their storage
+    list.assign(make_lines(0, 10));
+    lines = make_lines(0, 10);
+    list.insert(10_line, lines.begin(), lines.end());
+    kak_assert(list.get_storage(3_line) != list.get_storage(13_line));
+    list.set_interned(true);
+    kak_assert(list.get_storage(3_line) == list.get_storage(13_line));
+    lines = make_lines(3, 4);
+    list.insert(0_line, lines.begin(), lines.end());
+    list.set(1_line, StringData::create({"3\n"}));
+    kak_assert(list.get_storage(0_line) == list.get_storage(14_line) and
+               list.get_storage(1_line) == list.get_storage(14_line));
+    list.set_interned(false);
+
+    // chunks not accessed between two compressions get compressed
+    expected.clear();
+    for (int i = 0; i < 40; ++i)
+        expected.push_back(i % 7);
+    list.assign(make_lines(0, 40));
+    for (int i = 0; i < 40; ++i)
+        list.set(LineCount{i}, StringData::create({format("{}\n", i % 7)}));
+    const auto stats = LineList::compression_stats();
+    list.compress_cold_chunks();
+    list.compress_cold_chunks();
+    const size_t compressed = LineList::compression_stats().compressions - stats.compressions;
+    kak_assert(compressed > 1);
+    kak_assert(list[30_line] == "2\n");
+    kak_assert(LineList::compression_stats().decompressions == stats.decompressions + 1);
+    list.compress_cold_chunks();
+    kak_assert(LineList::compression_stats().compressions == stats.compressions + compressed);
+    check(list, expected);
+
+    list.compress_cold_chunks();
+    list.compress_cold_chunks();
+    list.compress_cold_chunks();
+    list.erase(2_line, 5_line);
+    expected.erase(expected.begin() + 2, expected.begin() + 5);
+    lines = make_lines(3, 4);
+    list.insert(30_line, lines.begin(), lines.end());
+    expected.insert(expected.begin() + 30, 3);
+    kak_assert(list.get_storage(20_line)->strview() == format("{}\n", expected[20]));
+    check(list, expected);
+}};
+
+}
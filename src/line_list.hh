@@ -0,0 +1,252 @@
+#ifndef line_list_hh_INCLUDED
+#define line_list_hh_INCLUDED
+
+#include "coord.hh"
+#include "file.hh"
+#include "ref_ptr.hh"
+#include "shared_string.hh"
+#include "units.hh"
+#include "vector.hh"
+
+namespace Kakoune
+{
+
+using BufferLines = Vector<StringDataPtr, MemoryDomain::BufferContent>;
+
+// A LineList stores the lines of a buffer as a sequence of bounded size
+// chunks, indexed by Fenwick trees of the chunk line and byte counts.
+//
+// Looking up a line, inserting or erasing lines inside a chunk costs
+// O(log(chunk count)) plus a move of at most a chunk size of pointers,
+// instead of a move of every following line. Splitting or merging chunks
+// rebuilds the index in O(chunk count). The last accessed chunk is cached
+// so that sequential accesses do not need to walk the index.
+//
+// Converting between byte offsets and coordinates walks the byte index,
+// then uses the line end offsets of the chunk, which are computed on
+// demand after it gets modified.
+//
+// Chunks can also refer to lines of a mapped file, those are only copied
+// to their own StringData when the chunk gets modified or when their
+// storage is requested.
+//
+// Chunks that are not accessed between two calls to compress_cold_chunks
+// get their lines compressed, they are decompressed as a whole when one
+// of their lines is read again, and copied back to their own StringData
+// like mapped chunks when modified.
+//
+// Chunks are reference counted so that BufferSnapshot can share them,
+// a shared chunk is copied before being modified.
+class LineList
+{
+public:
+    static constexpr int default_max_chunk_size = 1024;
+
+    LineList() = default;
+    LineList(BufferLines lines) { assign(std::move(lines)); }
+    // smaller chunks let tests split and merge them with a few lines
+    explicit LineList(int max_chunk_size) : m_max_chunk_size{max_chunk_size} {}
+
+    void assign(BufferLines lines);
+    // data must end with an end of line and stay valid as long as mapping is alive
+    void assign_mapped(StringView data, RefPtr<MappedFile> mapping);
+
+    [[gnu::always_inline]]
+    int size() const { return m_size; }
+    [[gnu::always_inline]]
+    bool empty() const { return m_size == 0; }
+    size_t byte_count() const { return m_byte_count; }
+
+    // offset of the first byte of line, which can be size()
+    size_t byte_offset(LineCount line) const;
+    // coordinates of the byte at offset, which must be less than byte_count()
+    BufferCoord byte_coord(size_t offset) const;
+
+    [[gnu::always_inline]]
+    const StringDataPtr& get_storage(LineCount line) const
+    {
+        auto loc = locate((int)line);
+        return materialized(loc.chunk).lines[loc.offset];
+    }
+
+    [[gnu::always_inline]]
+    StringView operator[](LineCount line) const
+    {
+        auto loc = locate((int)line);
+        return m_chunks[loc.chunk]->line(loc.offset);
+    }
+
+    StringView front() const { return m_chunks.front()->line(0); }
+    StringView back() const { return m_chunks.back()->line(m_chunks.back()->size() - 1); }
+
+    // replace the content of a line
+    void set(LineCount line, StringDataPtr content);
+    // insert moved lines from [begin, end) before given line
+    void insert(LineCount line, BufferLines::iterator begin, BufferLines::iterator end);
+    // erase lines in [begin, end)
+    void erase(LineCount begin, LineCount end);
+
+    // copy all mapped lines and release the mapping, which is returned so
+    // that its lifetime can be extended
+    RefPtr<MappedFile> materialize();
+
+    // When interned, lines are shared through the string registry with
+    // other identical lines, mapped lines are interned once materialized
+    void set_interned(bool interned);
+    const MappedFile* mapping() const { return m_mapping.get(); }
+
+    // compress the chunks not accessed since the previous call, and drop
+    // the decompressed copy of the compressed ones
+    void compress_cold_chunks();
+
+    struct CompressionStats
+    {
+        size_t compressions = 0;
+        size_t decompressions = 0;
+    };
+    // counts for all line lists, compressed data uses the CompressedLines
+    // memory domain
+    static const CompressionStats& compression_stats() { return ms_compression_stats; }
+
+    void check_invariant() const;
+
+    struct Chunk : RefCountable, UseMemoryDomain<MemoryDomain::BufferContent>
+    {
+        BufferLines lines;
+        // When not null, lines are read from the mapped data instead
+        const char* mapped = nullptr;
+        // End offset of each line from the chunk start, always valid for
+        // mapped and compressed chunks, otherwise empty until needed
+        mutable Vector<uint32_t, MemoryDomain::BufferContent> ends;
+        size_t bytes = 0;
+        // When not empty, lines are read from the decompressed copy of
+        // this data, made on first access
+        Vector<char, MemoryDomain::CompressedLines> packed;
+        mutable Vector<char, MemoryDomain::BufferContent> unpacked;
+        // set on each access, cleared by compress_cold_chunks
+        mutable bool used = true;
+
+        [[gnu::always_inline]]
+        bool has_lines() const { return not mapped and packed.empty(); }
+
+        [[gnu::always_inline]]
+        int size() const { return has_lines() ? (int)lines.size() : (int)ends.size(); }
+
+        [[gnu::always_inline]]
+        StringView line(int index) const
+        {
+            used = true;
+            if (not mapped)
+            {
+                if (packed.empty())
+                    return lines[index]->strview();
+                if (unpacked.empty())
+                    unpack();
+                return {unpacked.data() + (index == 0 ? 0 : ends[index-1]),
+                        unpacked.data() + ends[index]};
+            }
+            return {mapped + (index == 0 ? 0 : ends[index-1]),
+                    mapped + ends[index]};
+        }
+
+        const Vector<uint32_t, MemoryDomain::BufferContent>& line_ends() const;
+
+        void pack();
+        void unpack() const;
+    };
+
+    class const_iterator
+    {
+    public:
+        using value_type = StringView;
+        using difference_type = ssize_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        const_iterator(const RefPtr<Chunk>* chunk, int offset)
+            : m_chunk{chunk}, m_offset{offset} {}
+
+        StringView operator*() const { return (*m_chunk)->line(m_offset); }
+
+        const_iterator& operator++()
+        {
+            if (++m_offset == (*m_chunk)->size())
+            {
+                ++m_chunk;
+                m_offset = 0;
+            }
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const
+        { return m_chunk == other.m_chunk and m_offset == other.m_offset; }
+        bool operator!=(const const_iterator& other) const
+        { return not (*this == other); }
+
+    private:
+        const RefPtr<Chunk>* m_chunk;
+        int m_offset;
+    };
+
+    const_iterator begin() const { return {m_chunks.data(), 0}; }
+    const_iterator end() const { return {m_chunks.data() + m_chunks.size(), 0}; }
+
+private:
+    friend class BufferSnapshot;
+
+    struct Location
+    {
+        int chunk;
+        int offset;
+    };
+
+    [[gnu::always_inline]]
+    Location locate(int line) const
+    {
+        kak_assert(line >= 0 and line < m_size);
+        const int offset = line - m_cache_start;
+        if (offset >= 0 and offset < m_chunks[m_cache_chunk]->size())
+            return {m_cache_chunk, offset};
+        return locate_slow(line);
+    }
+
+    Location locate_slow(int line) const;
+    // Same as locate, but returns one past the last chunk line when line == size()
+    Location locate_insert_pos(int line) const;
+
+    int chunk_size(int chunk) const { return m_chunks[chunk]->size(); }
+    int min_chunk_size() const { return m_max_chunk_size / 8; }
+    // copy the mapped lines of the chunk if needed, and the chunk itself if
+    // it is shared, chunk content is unchanged
+    Chunk& materialized(int chunk) const;
+    int chunk_start(int chunk) const;
+    size_t chunk_byte_start(int chunk) const;
+
+    void update_index(int chunk, int delta);
+    void update_byte_index(int chunk, ssize_t delta);
+    void rebuild_index();
+    // replace chunks in [first, last) with chunks built from lines
+    void replace_chunks(int first, int last, BufferLines lines);
+    // remove empty chunks and merge small ones around the given chunk
+    void rebalance(int chunk);
+
+    int m_max_chunk_size = default_max_chunk_size;
+    Vector<RefPtr<Chunk>, MemoryDomain::BufferContent> m_chunks;
+    RefPtr<MappedFile> m_mapping;
+    bool m_interned = false;
+    static CompressionStats ms_compression_stats;
+    // Fenwick trees of chunk line and byte counts, 1-based
+    Vector<int, MemoryDomain::BufferContent> m_index;
+    Vector<size_t, MemoryDomain::BufferContent> m_byte_index;
+    int m_index_step = 0;
+    int m_size = 0;
+    size_t m_byte_count = 0;
+
+    mutable int m_cache_chunk = 0;
+    mutable int m_cache_start = 0;
+};
+
+}
+
+#endif // line_list_hh_INCLUDED
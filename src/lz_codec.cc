@@ -0,0 +1,211 @@
+#include "lz_codec.hh"
+
+#include "assert.hh"
+#include "unit_tests.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace Kakoune
+{
+
+namespace
+{
+
+// Each sequence starts with a token holding the literal count in its high
+// nibble and the match length minus min_match in its low one. A nibble of
+// 15 is followed by bytes added to it, up to the first one that is not 255.
+// Literals come next, then the match offset as two little endian bytes.
+// The last sequence only contains literals.
+constexpr size_t min_match = 4;
+constexpr size_t max_offset = 65535;
+constexpr int hash_bits = 12;
+
+uint32_t read32(const char* ptr)
+{
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+uint32_t hash(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - hash_bits);
+}
+
+// returns the length of the common prefix of a and b, a being before b
+// and b before end
+size_t common_length(const char* a, const char* b, const char* end)
+{
+    const char* const begin = b;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; end - b >= 8; a += 8, b += 8)
+    {
+        uint64_t lhs, rhs;
+        memcpy(&lhs, a, 8);
+        memcpy(&rhs, b, 8);
+        if (uint64_t diff = lhs ^ rhs)
+            return b - begin + __builtin_ctzll(diff) / 8;
+    }
+#endif
+    while (b != end and *a == *b)
+        ++a, ++b;
+    return b - begin;
+}
+
+char* write_length(char* out, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        *out++ = (char)255;
+    *out++ = (char)length;
+    return out;
+}
+
+size_t read_length(const unsigned char*& in, const unsigned char* end)
+{
+    size_t length = 0;
+    unsigned char byte;
+    do
+    {
+        kak_assert(in != end);
+        length += byte = *in++;
+    }
+    while (byte == 255);
+    return length;
+}
+
+char* write_literals(char* out, const char* literals, size_t count, unsigned match_nibble)
+{
+    *out++ = (char)((std::min<size_t>(count, 15) << 4) | match_nibble);
+    if (count >= 15)
+        out = write_length(out, count - 15);
+    memcpy(out, literals, count);
+    return out + count;
+}
+
+}
+
+size_t lz_compress(const char* data, size_t size, char* out)
+{
+    kak_assert(size < std::numeric_limits<uint32_t>::max());
+    const char* const begin = data;
+    const char* const end = data + size;
+    char* const out_begin = out;
+
+    uint32_t table[1 << hash_bits] = {};
+    const char* anchor = begin;
+    const char* pos = begin;
+    while (end - pos >= (ptrdiff_t)min_match)
+    {
+        const uint32_t value = read32(pos);
+        auto& entry = table[hash(value)];
+        const char* candidate = begin + entry;
+        entry = (uint32_t)(pos - begin);
+        if (candidate >= pos or (size_t)(pos - candidate) > max_offset or
+            read32(candidate) != value)
+        {
+            // skip faster through data that does not compress
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+
+        const size_t length = min_match + common_length(candidate + min_match, pos + min_match, end);
+        const size_t extra_length = length - min_match;
+        out = write_literals(out, anchor, pos - anchor, std::min<size_t>(extra_length, 15));
+        const size_t offset = pos - candidate;
+        *out++ = (char)(offset & 0xFF);
+        *out++ = (char)(offset >> 8);
+        if (extra_length >= 15)
+            out = write_length(out, extra_length - 15);
+
+        pos += length;
+        anchor = pos;
+    }
+    out = write_literals(out, anchor, end - anchor, 0);
+
+    kak_assert((size_t)(out - out_begin) <= lz_compress_bound(size));
+    return out - out_begin;
+}
+
+void lz_decompress(const char* data, size_t size, char* out, size_t out_size)
+{
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* const in_end = in + size;
+    char* const out_begin = out;
+    char* const out_end = out + out_size;
+
+    while (true)
+    {
+        kak_assert(in != in_end);
+        const unsigned token = *in++;
+        size_t literals = token >> 4;
+        if (literals == 15)
+            literals += read_length(in, in_end);
+        kak_assert(literals <= (size_t)(in_end - in) and literals <= (size_t)(out_end - out));
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+        if (in == in_end)
+            break;
+
+        kak_assert(in_end - in >= 2);
+        const size_t offset = in[0] | (in[1] << 8);
+        in += 2;
+        size_t length = (token & 15) + min_match;
+        if ((token & 15) == 15)
+            length += read_length(in, in_end);
+        kak_assert(offset != 0 and offset <= (size_t)(out - out_begin) and
+                   length <= (size_t)(out_end - out));
+
+        const char* ref = out - offset;
+        if (offset >= length)
+        {
+            memcpy(out, ref, length);
+            out += length;
+        }
+        else // overlapping match, repeating the last offset bytes
+        {
+            for (char* match_end = out + length; out != match_end; )
+                *out++ = *ref++;
+        }
+    }
+    kak_assert(out == out_end);
+}
+
+UnitTest test_lz_codec{[]()
+{
+    auto round_trip = [](const char* data, size_t size) {
+        char compressed[lz_compress_bound(4096)];
+        kak_assert(size <= 4096);
+        const size_t compressed_size = lz_compress(data, size, compressed);
+        char decompressed[4096];
+        lz_decompress(compressed, compressed_size, decompressed, size);
+        kak_assert(memcmp(data, decompressed, size) == 0);
+        return compressed_size;
+    };
+
+    kak_assert(round_trip("", 0) == 1);
+    round_trip("abc", 3);
+    round_trip("abcdabcdabcd", 12);
+
+    char data[4096];
+    for (int i = 0; i < 4096; ++i)
+        data[i] = "some text\n"[i % 10];
+    kak_assert(round_trip(data, 4096) < 64);
+
+    // long literal runs
+    uint32_t seed = 42;
+    for (int i = 0; i < 4096; ++i)
+        data[i] = (char)((seed = seed * 1103515245 + 12345) >> 16);
+    kak_assert(round_trip(data, 4096) <= lz_compress_bound(4096));
+    round_trip(data, 300);
+
+    // mixed matches and literals
+    for (int i = 0; i < 4096; ++i)
+        data[i] = (i / 64) % 3 == 0 ? data[i] : "line\n"[i % 5];
+    round_trip(data, 4096);
+}};
+
+}
@@ -0,0 +1,29 @@
+#ifndef lz_codec_hh_INCLUDED
+#define lz_codec_hh_INCLUDED
+
+#include <cstddef>
+
+namespace Kakoune
+{
+
+// Fast LZ77 codec for in memory data, using a format similar to LZ4
+// blocks: a sequence of literal runs, each followed by a back reference
+// of at least 4 bytes to the previous 64KiB of data.
+//
+// It favors speed over compression ratio, text usually shrinks to
+// between a third and a half of its size.
+
+// size of an output buffer large enough to compress size bytes
+constexpr size_t lz_compress_bound(size_t size) { return size + size / 255 + 16; }
+
+// compresses [data, data + size) to out, which must hold at least
+// lz_compress_bound(size) bytes, returns the compressed size
+size_t lz_compress(const char* data, size_t size, char* out);
+
+// decompresses [data, data + size) to out, which must hold exactly the
+// out_size bytes of the original data
+void lz_decompress(const char* data, size_t size, char* out, size_t out_size);
+
+}
+
+#endif // lz_codec_hh_INCLUDED
@@ -167,7 +167,7 @@ void register_env_vars()
             "cursor_byte_offset", false,
             [](StringView name, const Context& context) -> String
             { auto cursor = context.selections().main().cursor();
-              return to_string(context.buffer().distance({0,0}, cursor)); }
+              return to_string(context.buffer().byte_offset(cursor)); }
         }, {
             "selection_desc", false,
             [](StringView name, const Context& context)
@@ -268,6 +268,21 @@ static void check_timeout(const int& timeout)
         throw runtime_error{"the minimum acceptable timeout is 50 milliseconds"};
 }
 
+static void check_history_memory_limit(const int& limit)
+{
+    if (limit < 0) throw runtime_error{"history memory limit should be positive or zero"};
+}
+
+static void check_cold_lines_compression_delay(const int& delay)
+{
+    if (delay < 0) throw runtime_error{"cold lines compression delay should be positive or zero"};
+}
+
+static void check_regex_threads(const int& count)
+{
+    if (count < 0) throw runtime_error{"regex thread count should be positive or zero"};
+}
+
 static void check_extra_word_chars(const Vector<Codepoint, MemoryDomain::Options>& extra_chars)
 {
     if (contains_that(extra_chars, is_blank))
@@ -349,6 +364,20 @@ void register_options()
 
     reg.declare_option("debug", "various debug flags", DebugFlags::None);
     reg.declare_option("readonly", "prevent buffers from being modified", false);
+    reg.declare_option<int, check_history_memory_limit>(
+        "history_memory_limit", "size in bytes of the undo history to keep in memory "
+        "before moving the oldest part to a temporary file, 0 for no limit", 0);
+    reg.declare_option("intern_lines",
+                       "share the storage of identical lines between and inside buffers", false);
+    reg.declare_option<int, check_cold_lines_compression_delay>(
+        "cold_lines_compression_delay", "delay in seconds after which buffer lines that "
+        "were not accessed are compressed, 0 to disable", 0);
+    reg.declare_option("undo_journal_dir",
+                       "directory where the undo history of files is kept across sessions, "
+                       "empty to disable", ""_str);
+    reg.declare_option<int, check_regex_threads>(
+        "regex_threads", "maximum number of threads searching selections for regex "
+        "matches, 0 for one per processor core", 1);
     reg.declare_option<Vector<Codepoint, MemoryDomain::Options>, check_extra_word_chars>(
         "extra_word_chars",
         "Additional characters to be considered as words for insert completion",
@@ -400,6 +429,7 @@ std::unique_ptr<UserInterface> make_ui(UIType ui_type)
         void set_cursor(CursorMode, DisplayCoord) override {}
         void refresh(bool) override {}
         void set_on_key(OnKeyCallback) override {}
+        void read_available_keys() override {}
         void set_ui_options(const Options&) override {}
     };
 
@@ -674,6 +704,7 @@ int run_server(StringView session, StringView server_init,
             client_manager.clear_client_trash();
             client_manager.clear_window_trash();
             buffer_manager.clear_buffer_trash();
+            buffer_manager.compact_buffer_changes();
 
             if (sighup_raised)
             {
@@ -839,7 +870,7 @@ int main(int argc, char* argv[])
     set_signal_handler(SIGQUIT, signal_handler);
     set_signal_handler(SIGTERM, signal_handler);
     set_signal_handler(SIGPIPE, SIG_IGN);
-    set_signal_handler(SIGINT, [](int){});
+    set_signal_handler(SIGINT, [](int){ sigint_received = 1; });
     set_signal_handler(SIGCHLD, [](int){});
 
     Vector<String> params;
@@ -4,5 +4,6 @@ namespace Kakoune
 {
 
 size_t domain_allocated_bytes[(size_t)MemoryDomain::Count] = {};
+thread_local ptrdiff_t* worker_allocated_bytes = nullptr;
 
 }
@@ -17,6 +17,7 @@ enum class MemoryDomain
     String,
     SharedString,
     BufferContent,
+    CompressedLines,
     BufferMeta,
     Options,
     Highlight,
@@ -48,6 +49,7 @@ inline const char* domain_name(MemoryDomain domain)
         case MemoryDomain::String: return "String";
         case MemoryDomain::SharedString: return "SharedString";
         case MemoryDomain::BufferContent: return "BufferContent";
+        case MemoryDomain::CompressedLines: return "CompressedLines";
         case MemoryDomain::BufferMeta: return "BufferMeta";
         case MemoryDomain::Options: return "Options";
         case MemoryDomain::Highlight: return "Highlight";
@@ -76,17 +78,54 @@ inline const char* domain_name(MemoryDomain domain)
 
 extern size_t domain_allocated_bytes[(size_t)MemoryDomain::Count];
 
+// Worker threads count their allocations in the WorkerAllocations given
+// by the thread that started them, see below
+extern thread_local ptrdiff_t* worker_allocated_bytes;
+
 inline void on_alloc(MemoryDomain domain, size_t size)
 {
-    domain_allocated_bytes[(int)domain] += size;
+    if (ptrdiff_t* worker_bytes = worker_allocated_bytes)
+        worker_bytes[(int)domain] += size;
+    else
+        domain_allocated_bytes[(int)domain] += size;
 }
 
 inline void on_dealloc(MemoryDomain domain, size_t size)
 {
+    if (ptrdiff_t* worker_bytes = worker_allocated_bytes)
+    {
+        worker_bytes[(int)domain] -= size;
+        return;
+    }
     kak_assert(domain_allocated_bytes[(int)domain] >= size);
     domain_allocated_bytes[(int)domain] -= size;
 }
 
+// Allocation counts of a worker thread, which calls count_on_this_thread
+// when it starts. They are added to the counts of the thread owning this
+// once destroyed, which must happen after the worker was joined.
+struct WorkerAllocations
+{
+    WorkerAllocations() = default;
+    WorkerAllocations(const WorkerAllocations&) = delete;
+    WorkerAllocations& operator=(const WorkerAllocations&) = delete;
+
+    ~WorkerAllocations()
+    {
+        for (int domain = 0; domain < (int)MemoryDomain::Count; ++domain)
+        {
+            if (bytes[domain] > 0)
+                on_alloc((MemoryDomain)domain, bytes[domain]);
+            else if (bytes[domain] < 0)
+                on_dealloc((MemoryDomain)domain, -bytes[domain]);
+        }
+    }
+
+    void count_on_this_thread() { worker_allocated_bytes = bytes; }
+
+    ptrdiff_t bytes[(size_t)MemoryDomain::Count] = {};
+};
+
 template<typename T, MemoryDomain domain>
 struct Allocator
 {
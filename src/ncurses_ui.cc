@@ -248,11 +248,7 @@ default_colors = {
 NCursesUI::NCursesUI()
     : m_stdin_watcher{0, FdEvents::Read,
                       [this](FDWatcher&, FdEvents, EventMode mode) {
-        if (not m_on_key)
-            return;
-
-        while (auto key = get_next_key())
-            m_on_key(*key);
+        read_available_keys();
       }},
       m_assistant(assistant_clippy),
       m_colors{default_colors},
@@ -984,6 +980,15 @@ void NCursesUI::set_on_key(OnKeyCallback callback)
     m_on_key = std::move(callback);
 }
 
+void NCursesUI::read_available_keys()
+{
+    if (not m_on_key)
+        return;
+
+    while (auto key = get_next_key())
+        m_on_key(*key);
+}
+
 DisplayCoord NCursesUI::dimensions()
 {
     return m_dimensions;
@@ -49,6 +49,7 @@ public:
 
     DisplayCoord dimensions() override;
     void set_on_key(OnKeyCallback callback) override;
+    void read_available_keys() override;
     void set_ui_options(const Options& options) override;
 
     static void abort();
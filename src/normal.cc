@@ -9,6 +9,7 @@
 #include "commands.hh"
 #include "context.hh"
 #include "diff.hh"
+#include "event_manager.hh"
 #include "face_registry.hh"
 #include "file.hh"
 #include "flags.hh"
@@ -470,7 +471,7 @@ void command(Context& context, NormalParams params)
 
 void apply_diff(Buffer& buffer, BufferCoord pos, StringView before, StringView after)
 {
-    auto diffs = find_diff(before.begin(), (int)before.length(), after.begin(), (int)after.length());
+    auto diffs = find_text_diff(before, after);
 
     for (auto& diff : diffs)
     {
@@ -693,6 +694,22 @@ void paste_all(Context& context, NormalParams params)
         selections = std::move(result);
 }
 
+// Returns the check of an interrupt stopping searches on <c-c>, and when
+// interruptible_by_input is set, on new keys that would redo the search.
+// Only the client keys are read while searching, other event handlers
+// could modify or release the searched buffer data.
+RegexInterrupt::Check search_interrupt_check(const Context& context, bool interruptible_by_input)
+{
+    sigint_received = 0;
+    return [&context, interruptible_by_input] {
+        if (context.has_client())
+            context.client().read_available_inputs();
+        return sigint_received or
+               (interruptible_by_input and context.has_client() and
+                context.client().has_pending_inputs());
+    };
+}
+
 template<MatchDirection direction = MatchDirection::Forward, typename T>
 void regex_prompt(Context& context, String prompt, String default_regex, T func)
 {
@@ -725,7 +742,11 @@ void regex_prompt(Context& context, String prompt, String default_regex, T func)
                     context.push_jump();
 
                 if (not str.empty() or event == PromptEvent::Validate)
+                {
+                    // incremental search gives way to the next keys
+                    RegexInterrupt interrupt{search_interrupt_check(context, event == PromptEvent::Change)};
                     func(Regex{str.empty() ? default_regex : str, RegexCompileFlags::None, direction}, event, context);
+                }
             }
             catch (regex_error& err)
             {
@@ -796,6 +817,7 @@ void search_next(Context& context, NormalParams params)
     if (not str.empty())
     {
         Regex regex{str, RegexCompileFlags::None, direction};
+        RegexInterrupt interrupt{search_interrupt_check(context, false)};
         auto& selections = context.selections();
         bool main_wrapped = false;
         do {
@@ -881,7 +903,8 @@ void select_regex(Context& context, NormalParams params)
         RegisterManager::instance()[reg].set(context, ex.str());
 
         if (not ex.empty() and not ex.str().empty())
-            select_all_matches(context.selections(), ex, capture);
+            select_all_matches(context.selections(), ex, capture,
+                               context.options()["regex_threads"].get<int>());
     });
 }
 
@@ -906,7 +929,8 @@ void split_regex(Context& context, NormalParams params)
         RegisterManager::instance()[reg].set(context, ex.str());
 
         if (not ex.empty() and not ex.str().empty())
-            split_selections(context.selections(), ex, capture);
+            split_selections(context.selections(), ex, capture,
+                             context.options()["regex_threads"].get<int>());
     });
 }
 
@@ -988,22 +1012,8 @@ void keep(Context& context, NormalParams)
                  [](const Regex& ex, PromptEvent event, Context& context) {
         if (ex.empty() or event == PromptEvent::Abort)
             return;
-        const Buffer& buffer = context.buffer();
-
-        Vector<Selection> keep;
-        for (auto& sel : context.selections())
-        {
-            auto begin = buffer.iterator_at(sel.min());
-            auto end = utf8::next(buffer.iterator_at(sel.max()), buffer.end());
-            // We do not consider if end is on an eol, as it seems to
-            // give more intuitive behaviours in keep use cases.
-            const auto flags = match_flags(is_bol(begin.coord()), false,
-                                           is_bow(buffer, begin.coord()),
-                                           is_eow(buffer, end.coord())) |
-                               RegexExecFlags::AnyMatch;
-            if (regex_search(begin, end, ex, flags) == matching)
-                keep.push_back(sel);
-        }
+        auto keep = keep_matching(context.selections(), ex, matching,
+                                  context.options()["regex_threads"].get<int>());
         if (keep.empty())
             throw runtime_error("no selections remaining");
         context.selections_write_only() = std::move(keep);
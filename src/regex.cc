@@ -1,13 +1,56 @@
 #include "regex.hh"
 
+#include "buffer_utils.hh"
+#include "string_utils.hh"
+#include "unit_tests.hh"
+
 namespace Kakoune
 {
 
 Regex::Regex(StringView re, RegexCompileFlags flags, MatchDirection direction)
-    : m_impl{new CompiledRegex{compile_regex(re, flags, direction)}},
+    : m_impl{RegexCache::instance().get(re, flags, direction)},
       m_str{re.str()}
 {}
 
+RegexCache& RegexCache::instance()
+{
+    // Regexes can be built during static initialization
+    static RegexCache cache{4096};
+    return cache;
+}
+
+RefPtr<CompiledRegex> RegexCache::get(StringView re, RegexCompileFlags flags, MatchDirection direction)
+{
+    Key key{re.str(), flags, direction};
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        ++m_stats.hits;
+        it->value.last_use = ++m_use_count;
+        return it->value.regex;
+    }
+
+    ++m_stats.misses;
+    RefPtr<CompiledRegex> regex{new CompiledRegex{compile_regex(re, flags, direction)}};
+    if (m_entries.size() >= m_max_size)
+    {
+        auto oldest = std::min_element(m_entries.begin(), m_entries.end(),
+                                       [](auto& lhs, auto& rhs) { return lhs.value.last_use < rhs.value.last_use; });
+        m_entries.unordered_remove(oldest->key);
+        ++m_stats.evictions;
+    }
+    m_entries.insert({std::move(key), {regex, ++m_use_count}});
+    return regex;
+}
+
+void RegexCache::debug_stats() const
+{
+    write_to_debug_buffer("Regex cache stats:");
+    write_to_debug_buffer(format("  entries: {} (max: {})", m_entries.size(), m_max_size));
+    write_to_debug_buffer(format("  hits: {}, misses: {}, evictions: {}",
+                                 m_stats.hits, m_stats.misses, m_stats.evictions));
+}
+
 String option_to_string(const Regex& re)
 {
     return re.str();
@@ -18,4 +61,93 @@ void option_from_string(StringView str, Regex& re)
     re = Regex{str};
 }
 
+UnitTest test_regex_cache{[]()
+{
+    RegexCache cache{3};
+    auto regex = cache.get("fo+(bar)?", RegexCompileFlags::None, MatchDirection::Forward);
+    kak_assert(cache.get("fo+(bar)?", RegexCompileFlags::None, MatchDirection::Forward) == regex);
+    kak_assert(cache.stats().hits == 1 and cache.stats().misses == 1);
+    kak_assert(cache.get("fo+(bar)?", RegexCompileFlags::NoSubs, MatchDirection::Forward) != regex);
+    kak_assert(cache.get("fo+(bar)?", RegexCompileFlags::None, MatchDirection::Backward) != regex);
+
+    // failed compilations are not cached
+    for (int i = 0; i < 2; ++i)
+    {
+        try { cache.get("fo+(bar", RegexCompileFlags::None, MatchDirection::Forward); kak_assert(false); }
+        catch (regex_error&) {}
+    }
+    kak_assert(cache.size() == 3 and cache.stats().misses == 5);
+
+    // the least recently used entry is evicted
+    cache.get("fo+(bar)?", RegexCompileFlags::None, MatchDirection::Forward);
+    cache.get("baz", RegexCompileFlags::None, MatchDirection::Forward);
+    kak_assert(cache.size() == 3 and cache.stats().evictions == 1);
+    kak_assert(cache.get("fo+(bar)?", RegexCompileFlags::None, MatchDirection::Forward) == regex);
+    cache.get("fo+(bar)?", RegexCompileFlags::NoSubs, MatchDirection::Forward);
+    kak_assert(cache.stats().misses == 7 and cache.stats().evictions == 2);
+
+    kak_assert(Regex{"fo+(bar)?"}.impl() == Regex{"fo+(bar)?"}.impl());
+}};
+
+UnitTest test_regex_vm_reuse{[]()
+{
+    Regex regex{"(fo+)(bar)?"};
+    auto count_matches = [&](auto begin, auto end) {
+        int count = 0;
+        for (RegexIterator<decltype(begin)> it{begin, end, regex}, it_end; it != it_end; ++it)
+            ++count;
+        return count;
+    };
+
+    // searches after the first one reuse its VM and saves
+    const StringView text = "foo foobar fooo\n";
+    kak_assert(count_matches(text.begin(), text.end()) == 3);
+    const size_t built = regex_vm_stats.vms_built;
+    const size_t reused = regex_vm_stats.vms_reused;
+    const size_t saves = regex_vm_stats.saves_allocated;
+    kak_assert(count_matches(text.begin(), text.end()) == 3);
+    kak_assert(regex_vm_stats.vms_built == built and regex_vm_stats.vms_reused == reused + 4 and
+               regex_vm_stats.saves_allocated == saves);
+
+    // idle VMs do not keep iterators to the buffers they searched
+    Buffer buffer("test", Buffer::Flags::None, text);
+    kak_assert(count_matches(buffer.begin(), buffer.end()) == 3);
+}};
+
+UnitTest test_regex_buffer_spans{[]()
+{
+    // searches read the bytes of buffer lines directly, and find the same
+    // matches as on the whole text
+    const StringView text = "foo bar\nbaz été qux\n\nfoobar\n  x1 y22\n";
+    Buffer buffer("test", Buffer::Flags::None, text);
+    for (auto re : {"o+b", R"(\bba\w)", R"(é\w)", R"(^\s*\w\d+)", R"(r\n\n?f)",
+                    R"(qux$)", R"(\d{2})", "bar\nbaz", "zz", "(?i)BA"})
+    {
+        Regex regex{re};
+        Vector<BufferCoord> in_buffer, in_text;
+        for (RegexIterator<BufferIterator> it{buffer.begin(), buffer.end(), regex}, end; it != end; ++it)
+            in_buffer.push_back((*it)[0].first.coord());
+        for (RegexIterator<const char*> it{text.begin(), text.end(), regex}, end; it != end; ++it)
+            in_text.push_back(buffer.byte_coord((int)((*it)[0].first - text.begin())));
+        kak_assert(in_buffer == in_text);
+        kak_assert(regex_search(buffer.begin(), buffer.end(), regex) == not in_text.empty());
+
+        // backward searches read the bytes before their end
+        Regex backward{re, RegexCompileFlags::None, MatchDirection::Backward};
+        for (ByteCount offset = 0; offset <= text.length(); ++offset)
+        {
+            if (offset != text.length() and not utf8::is_character_start(text[offset]))
+                continue;
+            MatchResults<BufferIterator> buffer_match;
+            MatchResults<const char*> text_match;
+            const bool found = regex_search<BufferIterator, MatchDirection::Backward>(
+                buffer.begin(), buffer.iterator_at(buffer.byte_coord(offset)), buffer_match, backward);
+            kak_assert(found == regex_search<const char*, MatchDirection::Backward>(
+                text.begin(), text.begin() + (int)offset, text_match, backward));
+            kak_assert(not found or buffer_match[0].first.coord() ==
+                                    buffer.byte_coord((int)(text_match[0].first - text.begin())));
+        }
+    }
+}};
+
 }
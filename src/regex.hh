@@ -32,6 +32,57 @@ private:
     String m_str;
 };
 
+// Process wide cache of compiled regexes. Hooks, options, prompts and
+// highlighters keep building Regex objects from the same strings, which
+// then share a single CompiledRegex. The most recently used ones are kept
+// even when no Regex refers to them anymore.
+class RegexCache
+{
+public:
+    explicit RegexCache(size_t max_size) : m_max_size{max_size} {}
+
+    static RegexCache& instance();
+
+    RefPtr<CompiledRegex> get(StringView re, RegexCompileFlags flags, MatchDirection direction);
+
+    void clear() { m_entries.clear(); }
+    size_t size() const { return m_entries.size(); }
+
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+    };
+    const Stats& stats() const { return m_stats; }
+    void debug_stats() const;
+
+private:
+    struct Key
+    {
+        String re;
+        RegexCompileFlags flags;
+        MatchDirection direction;
+
+        friend bool operator==(const Key& lhs, const Key& rhs)
+        {
+            return lhs.re == rhs.re and lhs.flags == rhs.flags and lhs.direction == rhs.direction;
+        }
+        friend size_t hash_value(const Key& key) { return hash_values(key.re, key.flags, key.direction); }
+    };
+
+    struct Entry
+    {
+        RefPtr<CompiledRegex> regex;
+        size_t last_use;
+    };
+
+    HashMap<Key, Entry, MemoryDomain::Regex> m_entries;
+    size_t m_max_size;
+    size_t m_use_count = 0;
+    Stats m_stats;
+};
+
 template<typename Iterator>
 struct MatchResults
 {
@@ -95,6 +146,9 @@ struct MatchResults
         m_values.swap(other.m_values);
     }
 
+    // lets searches store their captures in place, reusing the storage
+    Vector<Iterator, MemoryDomain::Regex>& values() { return m_values; }
+
 private:
     Vector<Iterator, MemoryDomain::Regex> m_values;
 };
@@ -116,10 +170,8 @@ bool regex_match(It begin, It end, const Regex& re)
 template<typename It>
 bool regex_match(It begin, It end, MatchResults<It>& res, const Regex& re)
 {
-    Vector<It, MemoryDomain::Regex> captures;
-    const bool matched = regex_match(begin, end, captures, *re.impl());
-    res = matched ? MatchResults<It>{std::move(captures)} : MatchResults<It>{};
-    return matched;
+    res.values().clear();
+    return regex_match(begin, end, res.values(), *re.impl());
 }
 
 template<typename It>
@@ -133,10 +185,8 @@ template<typename It, MatchDirection direction = MatchDirection::Forward>
 bool regex_search(It begin, It end, MatchResults<It>& res, const Regex& re,
                   RegexExecFlags flags = RegexExecFlags::None)
 {
-    Vector<It, MemoryDomain::Regex> captures;
-    const bool matched = regex_search<It, direction>(begin, end, captures, *re.impl(), flags);
-    res = matched ? MatchResults<It>{std::move(captures)} : MatchResults<It>{};
-    return matched;
+    res.values().clear();
+    return regex_search<It, direction>(begin, end, res.values(), *re.impl(), flags);
 }
 
 String option_to_string(const Regex& re);
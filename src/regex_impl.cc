@@ -10,12 +10,39 @@
 #include "vector.hh"
 
 #include <cstring> 
+#include <mutex>
+#include <thread>
 
 namespace Kakoune
 {
 
 constexpr Codepoint CompiledRegex::StartChars::other;
 
+void CharacterClass::compute_ascii()
+{
+    for (Codepoint cp = 0; cp < 128; ++cp)
+    {
+        if (matches_slow(cp))
+            m_ascii[cp / 64] |= 1ull << (cp % 64);
+    }
+}
+
+bool CharacterClass::matches_slow(Codepoint cp) const
+{
+    if (ignore_case)
+        cp = to_lower(cp);
+
+    auto it = std::lower_bound(ranges.begin(), ranges.end(), cp,
+                               [](auto& range, Codepoint cp)
+                               { return range.max < cp; });
+
+    auto found = (it != ranges.end() and it->min <= cp) or
+    contains_that(ctypes, [cp](auto& c) {
+        return (bool)iswctype(cp, c.first) == c.second;
+    }) or (not excluded.empty() and not contains(excluded, cp));
+    return negative ? not found : found;
+}
+
 struct ParsedRegex
 {
     enum Op : char
@@ -80,7 +107,7 @@ struct ParsedRegex
     };
 
     Vector<Node, MemoryDomain::Regex> nodes;
-    Vector<std::function<bool (Codepoint)>, MemoryDomain::Regex> matchers;
+    Vector<CharacterClass, MemoryDomain::Regex> character_classes;
     size_t capture_count;
 };
 
@@ -323,13 +350,14 @@ private:
                                 [cp = to_lower(cp)](auto& c) { return c.cp == cp; });
         if (class_it != std::end(character_class_escapes))
         {
-            auto matcher_id = m_parsed_regex.matchers.size();
-            m_parsed_regex.matchers.push_back(
-                [ctype = class_it->ctype ? wctype(class_it->ctype) : (wctype_t)0,
-                 chars = class_it->additional_chars, neg = is_upper(cp)] (Codepoint cp) {
-                    return ((ctype != 0 and iswctype(cp, ctype)) or contains(chars, cp)) != neg;
-                });
-            return new_node(ParsedRegex::Matcher, matcher_id);
+            CharacterClass character_class;
+            if (class_it->ctype)
+                character_class.ctypes.push_back({wctype(class_it->ctype), true});
+            for (auto& c : class_it->additional_chars)
+                character_class.ranges.push_back({(Codepoint)c, (Codepoint)c});
+            normalize_ranges(character_class.ranges);
+            character_class.negative = is_upper(cp);
+            return add_character_class(std::move(character_class));
         }
 
         // CharacterEscape
@@ -383,7 +411,7 @@ private:
         parse_error(format("unknown atom escape '{}'", cp));
     }
 
-    struct CharRange { Codepoint min, max; };
+    using CharRange = CharacterClass::Range;
 
     void normalize_ranges(Vector<CharRange, MemoryDomain::Regex>& ranges)
     {
@@ -505,27 +533,20 @@ private:
             ranges.size() == 1 and ranges.front().min == ranges.front().max)
             return new_node(ParsedRegex::Literal, ranges.front().min);
 
-        auto matcher = [ranges = std::move(ranges),
-                        ctypes = std::move(ctypes),
-                        excluded = std::move(excluded),
-                        negative, ignore_case = m_ignore_case] (Codepoint cp) {
-            if (ignore_case)
-                cp = to_lower(cp);
-
-            auto it = std::lower_bound(ranges.begin(), ranges.end(), cp,
-                                       [](auto& range, Codepoint cp)
-                                       { return range.max < cp; });
-
-            auto found = (it != ranges.end() and it->min <= cp) or
-            contains_that(ctypes, [cp](auto& c) {
-                return (bool)iswctype(cp, c.first) == c.second;
-            }) or (not excluded.empty() and not contains(excluded, cp));
-            return negative ? not found : found;
-        };
-
-        auto matcher_id = m_parsed_regex.matchers.size();
-        m_parsed_regex.matchers.push_back(std::move(matcher));
+        CharacterClass character_class;
+        character_class.ranges = std::move(ranges);
+        character_class.ctypes = std::move(ctypes);
+        character_class.excluded = std::move(excluded);
+        character_class.negative = negative;
+        character_class.ignore_case = m_ignore_case;
+        return add_character_class(std::move(character_class));
+    }
 
+    NodeIndex add_character_class(CharacterClass character_class)
+    {
+        character_class.compute_ascii();
+        auto matcher_id = m_parsed_regex.character_classes.size();
+        m_parsed_regex.character_classes.push_back(std::move(character_class));
         return new_node(ParsedRegex::Matcher, matcher_id);
     }
 
@@ -661,10 +682,13 @@ struct RegexCompiler
         write_search_prefix();
         compile_node(0);
         push_inst(CompiledRegex::Match);
-        m_program.matchers = m_parsed_regex.matchers;
+        m_program.character_classes = m_parsed_regex.character_classes;
         m_program.save_count = m_parsed_regex.capture_count * 2;
         m_program.direction = direction;
         m_program.start_chars = compute_start_chars();
+        if (m_forward)
+            m_program.required_literal = compute_required_literal();
+        m_program.literal_pattern = compute_literal_pattern();
     }
 
     CompiledRegex get_compiled_regex() { return std::move(m_program); }
@@ -712,6 +736,9 @@ private:
             }
             case ParsedRegex::Alternation:
             {
+                if (compile_literal_trie(index))
+                    break;
+
                 auto split_pos = m_program.instructions.size();
                 for_each_child(m_parsed_regex, index, [this, index](ParsedRegex::NodeIndex child) {
                     if (child != index+1)
@@ -797,6 +824,159 @@ private:
         return start_pos;
     }
 
+    struct TrieWord
+    {
+        Vector<Codepoint, MemoryDomain::Regex> codepoints;
+        // lower is higher
+        int priority;
+    };
+
+    struct TrieEnds
+    {
+        Vector<uint32_t> goto_end_offsets;
+        Vector<std::pair<uint32_t, uint32_t>> switch_end_targets;
+    };
+
+    // Compiles an alternation of literal strings, as used for keyword lists,
+    // to a trie of LiteralSwitch instructions so that matching it does not
+    // need a thread per alternative. Returns false if index is not suitable.
+    bool compile_literal_trie(ParsedRegex::NodeIndex index)
+    {
+        int alternative_count = 0;
+        for_each_child(m_parsed_regex, index, [&](ParsedRegex::NodeIndex) { ++alternative_count; return true; });
+        if (alternative_count < 2)
+            return false;
+
+        Vector<TrieWord> words;
+        int ignore_case = -1;
+        const bool is_literal = for_each_child(m_parsed_regex, index, [&](ParsedRegex::NodeIndex child) {
+            auto& sequence = get_node(child);
+            if (sequence.op != ParsedRegex::Sequence or sequence.quantifier.type != ParsedRegex::Quantifier::One or
+                sequence.children_end == child + 1)
+                return false;
+
+            // The split chain compiled for alternations gives the highest priority
+            // to the first alternative, then to the others in reverse order
+            const int alternative = words.size();
+            words.push_back({{}, alternative == 0 ? 0 : alternative_count - alternative});
+            auto& word = words.back().codepoints;
+            const bool literal = for_each_child(m_parsed_regex, child, [&](ParsedRegex::NodeIndex index) {
+                auto& node = get_node(index);
+                if (node.op != ParsedRegex::Literal or node.quantifier.type != ParsedRegex::Quantifier::One or
+                    (ignore_case != -1 and node.ignore_case != (bool)ignore_case))
+                    return false;
+                ignore_case = node.ignore_case;
+                word.push_back(node.ignore_case ? to_lower(node.value) : node.value);
+                return true;
+            });
+            if (not m_forward)
+                std::reverse(word.begin(), word.end());
+            return literal;
+        });
+        if (not is_literal)
+            return false;
+
+        std::sort(words.begin(), words.end(), [](auto& lhs, auto& rhs) {
+            return std::lexicographical_compare(lhs.codepoints.begin(), lhs.codepoints.end(),
+                                                rhs.codepoints.begin(), rhs.codepoints.end());
+        });
+        Vector<uint32_t> indices;
+        for (uint32_t i = 0; i < words.size(); ++i)
+            indices.push_back(i);
+
+        TrieEnds ends;
+        compile_trie_node(words, indices, 0, ignore_case, ends);
+        const uint32_t end = m_program.instructions.size();
+        for (auto offset : ends.goto_end_offsets)
+            m_program.instructions[offset].param = end;
+        for (auto& target : ends.switch_end_targets)
+            m_program.literal_switches[target.first].targets[target.second].second = end;
+        return true;
+    }
+
+    // Compiles the trie node of the given words, sorted and sharing their
+    // first depth codepoints. Alternatives are only competing when one is
+    // a prefix of the other, so when a word ends here the longer ones are
+    // split between a sub-trie tried before ending and one tried after.
+    uint32_t compile_trie_node(const Vector<TrieWord>& words, const Vector<uint32_t>& indices,
+                               uint32_t depth, bool ignore_case, TrieEnds& ends)
+    {
+        const uint32_t start_pos = m_program.instructions.size();
+        auto longer_begin = std::find_if(indices.begin(), indices.end(),
+                                         [&](uint32_t i) { return words[i].codepoints.size() > depth; });
+        if (longer_begin != indices.begin()) // a word ends here
+        {
+            int priority = std::numeric_limits<int>::max();
+            for (auto it = indices.begin(); it != longer_begin; ++it)
+                priority = std::min(priority, words[*it].priority);
+
+            Vector<uint32_t> before, after;
+            for (auto it = longer_begin; it != indices.end(); ++it)
+                (words[*it].priority < priority ? before : after).push_back(*it);
+
+            if (before.empty() and after.empty())
+                ends.goto_end_offsets.push_back(push_inst(CompiledRegex::Jump));
+            else if (after.empty())
+            {
+                ends.goto_end_offsets.push_back(push_inst(CompiledRegex::Split_PrioritizeParent));
+                compile_trie_children(words, before, depth, ignore_case, ends);
+            }
+            else
+            {
+                if (not before.empty())
+                {
+                    auto split_pos = push_inst(CompiledRegex::Split_PrioritizeParent);
+                    compile_trie_children(words, before, depth, ignore_case, ends);
+                    m_program.instructions[split_pos].param = m_program.instructions.size();
+                }
+                ends.goto_end_offsets.push_back(push_inst(CompiledRegex::Split_PrioritizeChild));
+                compile_trie_children(words, after, depth, ignore_case, ends);
+            }
+        }
+        else
+            compile_trie_children(words, indices, depth, ignore_case, ends);
+        return start_pos;
+    }
+
+    // Compiles the matching of the codepoint at depth of the given words,
+    // which are all longer than depth
+    void compile_trie_children(const Vector<TrieWord>& words, const Vector<uint32_t>& indices,
+                               uint32_t depth, bool ignore_case, TrieEnds& ends)
+    {
+        Vector<Vector<uint32_t>> children;
+        Vector<Codepoint> codepoints;
+        for (auto i : indices)
+        {
+            const Codepoint cp = words[i].codepoints[depth];
+            if (codepoints.empty() or codepoints.back() != cp)
+            {
+                codepoints.push_back(cp);
+                children.emplace_back();
+            }
+            children.back().push_back(i);
+        }
+
+        if (children.size() == 1) // no need for a switch
+        {
+            push_inst(ignore_case ? CompiledRegex::Literal_IgnoreCase : CompiledRegex::Literal, codepoints[0]);
+            compile_trie_node(words, children[0], depth + 1, ignore_case, ends);
+            return;
+        }
+
+        const uint32_t switch_index = m_program.literal_switches.size();
+        m_program.literal_switches.push_back({{}, ignore_case});
+        push_inst(CompiledRegex::LiteralSwitch, switch_index);
+        for (size_t i = 0; i < children.size(); ++i)
+        {
+            const bool leaf = std::all_of(children[i].begin(), children[i].end(),
+                                          [&](uint32_t w) { return words[w].codepoints.size() == depth + 1; });
+            if (leaf)
+                ends.switch_end_targets.emplace_back(switch_index, (uint32_t)i);
+            const uint32_t target = leaf ? 0 : compile_trie_node(words, children[i], depth + 1, ignore_case, ends);
+            m_program.literal_switches[switch_index].targets.emplace_back(codepoints[i], target);
+        }
+    }
+
     uint32_t compile_node(ParsedRegex::NodeIndex index)
     {
         auto& node = get_node(index);
@@ -857,7 +1037,7 @@ private:
         uint32_t res = m_program.instructions.size();
         if (res > max_instructions)
             throw regex_error(format("regex compiled to more than {} instructions", max_instructions));
-        m_program.instructions.push_back({ op, false, 0, param });
+        m_program.instructions.push_back({ op, param });
         return res;
     }
 
@@ -917,7 +1097,7 @@ private:
                 return node.quantifier.allows_none();
             case ParsedRegex::Matcher:
                 for (Codepoint c = 0; c < CompiledRegex::StartChars::count; ++c)
-                    if (m_program.matchers[node.value](c))
+                    if (m_program.character_classes[node.value].matches(c))
                         start_chars.map[c] = true;
                 start_chars.map[CompiledRegex::StartChars::other] = true; // stay safe
                 return node.quantifier.allows_none();
@@ -973,6 +1153,191 @@ private:
         return std::make_unique<CompiledRegex::StartChars>(start_chars);
     }
 
+    // Number of codepoints matched by a node, max is -1 when unbounded
+    struct Width
+    {
+        int min, max;
+
+        Width operator+(Width other) const
+        {
+            return {min + other.min, (max < 0 or other.max < 0) ? -1 : max + other.max};
+        }
+    };
+
+    Width node_width(ParsedRegex::NodeIndex index) const
+    {
+        auto& node = get_node(index);
+        Width width{0, 0};
+        switch (node.op)
+        {
+            case ParsedRegex::Literal:
+            case ParsedRegex::AnyChar:
+            case ParsedRegex::Matcher:
+                width = {1, 1};
+                break;
+            case ParsedRegex::Sequence:
+                for_each_child(m_parsed_regex, index, [&](ParsedRegex::NodeIndex child) {
+                    width = width + node_width(child);
+                    return true;
+                });
+                break;
+            case ParsedRegex::Alternation:
+            {
+                bool first = true;
+                for_each_child(m_parsed_regex, index, [&](ParsedRegex::NodeIndex child) {
+                    const auto child_width = node_width(child);
+                    if (first)
+                        width = child_width;
+                    else
+                        width = {std::min(width.min, child_width.min),
+                                 (width.max < 0 or child_width.max < 0) ? -1 : std::max(width.max, child_width.max)};
+                    first = false;
+                    return true;
+                });
+                break;
+            }
+            default: // assertions do not consume
+                break;
+        }
+
+        auto& quantifier = node.quantifier;
+        int min_count = 1, max_count = 1;
+        switch (quantifier.type)
+        {
+            case ParsedRegex::Quantifier::One: break;
+            case ParsedRegex::Quantifier::Optional: min_count = 0; break;
+            case ParsedRegex::Quantifier::RepeatZeroOrMore: min_count = 0; max_count = -1; break;
+            case ParsedRegex::Quantifier::RepeatOneOrMore: max_count = -1; break;
+            case ParsedRegex::Quantifier::RepeatMinMax:
+                min_count = std::max<int>(quantifier.min, 0);
+                max_count = quantifier.max;
+                break;
+        }
+        if (width.max == 0 or max_count == 0)
+            return {0, 0};
+        return {width.min * min_count,
+                (width.max < 0 or max_count < 0) ? -1 : width.max * max_count};
+    }
+
+    struct LiteralRun
+    {
+        String value;
+        int length = 0;
+        Width offset{0, 0};
+    };
+
+    static void end_literal_run(LiteralRun& current, LiteralRun& best)
+    {
+        // prefer runs at a fixed offset, which allow to skip to the match start
+        auto fixed = [](const LiteralRun& run) { return run.offset.min == run.offset.max; };
+        if (current.length > best.length or
+            (current.length == best.length and fixed(current) and not fixed(best)))
+            best = std::move(current);
+        current = LiteralRun{};
+    }
+
+    // Walks the nodes that are always matched exactly once, in order, collecting
+    // runs of consecutive literals and keeping the longest one in best. offset is
+    // the number of codepoints matched before the current node.
+    void find_literal_runs(ParsedRegex::NodeIndex index, Width& offset,
+                           LiteralRun& current, LiteralRun& best) const
+    {
+        auto& node = get_node(index);
+        if (node.quantifier.type == ParsedRegex::Quantifier::One)
+        {
+            switch (node.op)
+            {
+                case ParsedRegex::Literal:
+                    if (node.ignore_case)
+                        break;
+                    if (current.length++ == 0)
+                        current.offset = offset;
+                    utf8::dump(std::back_inserter(current.value), node.value);
+                    offset = offset + Width{1, 1};
+                    return;
+                case ParsedRegex::Sequence:
+                    for_each_child(m_parsed_regex, index, [&](ParsedRegex::NodeIndex child) {
+                        find_literal_runs(child, offset, current, best);
+                        return true;
+                    });
+                    return;
+                case ParsedRegex::Alternation:
+                    if (get_node(index+1).children_end != node.children_end)
+                        break;
+                    find_literal_runs(index+1, offset, current, best);
+                    return;
+                case ParsedRegex::AnyChar:
+                case ParsedRegex::Matcher:
+                    break;
+                default: // assertions do not consume, literals around them are contiguous
+                    return;
+            }
+        }
+        end_literal_run(current, best);
+        offset = offset + node_width(index);
+    }
+
+    [[gnu::noinline]]
+    std::unique_ptr<CompiledRegex::RequiredLiteral> compute_required_literal() const
+    {
+        Width offset{0, 0};
+        LiteralRun current, best;
+        find_literal_runs(0, offset, current, best);
+        end_literal_run(current, best);
+
+        // single characters are better handled by start chars
+        if (best.length < 2)
+            return nullptr;
+
+        return std::make_unique<CompiledRegex::RequiredLiteral>(CompiledRegex::RequiredLiteral{
+            std::move(best.value), best.offset.min == best.offset.max ? best.offset.min : -1});
+    }
+
+    // Detects regexes made of a single sequence of literals that are all case
+    // sensitive, or all ignore case and ascii once lowercased. Forward regexes
+    // can start and end with a word boundary as well.
+    std::unique_ptr<CompiledRegex::LiteralPattern> compute_literal_pattern() const
+    {
+        auto& root = get_node(0);
+        const ParsedRegex::NodeIndex sequence = 1;
+        if (root.children_end == sequence or get_node(sequence).children_end != root.children_end or
+            get_node(sequence).quantifier.type != ParsedRegex::Quantifier::One)
+            return nullptr;
+
+        auto is_word_boundary = [this](ParsedRegex::NodeIndex index) {
+            auto& node = get_node(index);
+            return m_forward and node.op == ParsedRegex::WordBoundary and
+                   node.quantifier.type == ParsedRegex::Quantifier::One;
+        };
+
+        CompiledRegex::LiteralPattern pattern{{}, false, false, false};
+        const bool is_literal = for_each_child(m_parsed_regex, sequence, [&](ParsedRegex::NodeIndex child) {
+            auto& node = get_node(child);
+            if (pattern.word_end)
+                return false;
+            if (is_word_boundary(child))
+            {
+                (child == sequence + 1 ? pattern.word_start : pattern.word_end) = true;
+                return true;
+            }
+            if (node.op != ParsedRegex::Literal or node.quantifier.type != ParsedRegex::Quantifier::One or
+                (not pattern.value.empty() and node.ignore_case != pattern.ignore_case))
+                return false;
+
+            pattern.ignore_case = node.ignore_case;
+            if (not node.ignore_case)
+                utf8::dump(std::back_inserter(pattern.value), node.value);
+            else if (to_lower(node.value) < 0x80)
+                pattern.value.push_back((char)to_lower(node.value));
+            else
+                return false;
+            return true;
+        });
+        if (not is_literal or pattern.value.empty())
+            return nullptr;
+        return std::make_unique<CompiledRegex::LiteralPattern>(std::move(pattern));
+    }
+
     const ParsedRegex::Node& get_node(ParsedRegex::NodeIndex index) const
     {
         return m_parsed_regex.nodes[index];
@@ -1001,6 +1366,15 @@ void dump_regex(const CompiledRegex& program)
             case CompiledRegex::AnyChar:
                 printf("any char\n");
                 break;
+            case CompiledRegex::LiteralSwitch:
+            {
+                auto& literal_switch = program.literal_switches[inst.param];
+                printf("literal switch%s", literal_switch.ignore_case ? " (ignore case)" : "");
+                for (auto& target : literal_switch.targets)
+                    printf(" %lc:%u", target.first, target.second);
+                printf("\n");
+                break;
+            }
             case CompiledRegex::Jump:
                 printf("jump %u\n", inst.param);
                 break;
@@ -1077,6 +1451,13 @@ void dump_regex(const CompiledRegex& program)
                 printf("match\n");
         }
     }
+    if (program.required_literal)
+        printf("required literal: '%s' at offset %d\n", program.required_literal->value.c_str(),
+               program.required_literal->offset);
+    if (auto& pattern = program.literal_pattern)
+        printf("literal pattern: %s'%s'%s%s\n", pattern->word_start ? "\\b" : "",
+               pattern->value.c_str(), pattern->word_end ? "\\b" : "",
+               pattern->ignore_case ? " ignoring case" : "");
 }
 
 CompiledRegex compile_regex(StringView re, RegexCompileFlags flags, MatchDirection direction)
@@ -1084,6 +1465,247 @@ CompiledRegex compile_regex(StringView re, RegexCompileFlags flags, MatchDirecti
     return RegexCompiler{RegexParser::parse(re), flags, direction}.get_compiled_regex();
 }
 
+constexpr RegexDFA::StateIndex RegexDFA::failed;
+constexpr RegexDFA::StateIndex RegexDFA::too_big;
+constexpr size_t RegexDFA::default_max_states;
+
+RegexVMStats regex_vm_stats;
+
+// guards the idle DFAs and VMs of all programs, as it is only held to move one
+static std::mutex idle_mutex;
+
+std::unique_ptr<RegexDFA> CompiledRegex::take_dfa() const
+{
+    {
+        std::lock_guard<std::mutex> lock{idle_mutex};
+        if (not idle_dfas.empty())
+        {
+            auto dfa = std::move(idle_dfas.back());
+            idle_dfas.pop_back();
+            return dfa;
+        }
+    }
+    return std::make_unique<RegexDFA>(*this);
+}
+
+void CompiledRegex::give_back_dfa(std::unique_ptr<RegexDFA> dfa) const
+{
+    std::lock_guard<std::mutex> lock{idle_mutex};
+    idle_dfas.push_back(std::move(dfa));
+}
+
+std::unique_ptr<RegexVMBase> CompiledRegex::take_vm(const std::type_info& type) const
+{
+    std::lock_guard<std::mutex> lock{idle_mutex};
+    auto it = std::find_if(idle_vms.begin(), idle_vms.end(),
+                           [&](auto& vm) { return typeid(*vm) == type; });
+    if (it == idle_vms.end())
+        return nullptr;
+    auto vm = std::move(*it);
+    idle_vms.erase(it);
+    return vm;
+}
+
+void CompiledRegex::give_back_vm(std::unique_ptr<RegexVMBase> vm) const
+{
+    std::lock_guard<std::mutex> lock{idle_mutex};
+    idle_vms.push_back(std::move(vm));
+}
+
+RegexDFA::RegexDFA(const CompiledRegex& program, size_t max_states)
+    : m_max_states{max_states}, m_visited(program.instructions.size(), 0)
+{
+    m_enabled = std::all_of(program.instructions.begin(), program.instructions.end(),
+                            [](const CompiledRegex::Instruction& inst) {
+                                return inst.op < CompiledRegex::LookAhead;
+                            });
+    std::fill(&m_start_states[0][0], &m_start_states[0][0] + 2 * context_count, -1);
+}
+
+RegexDFA::StateIndex RegexDFA::start_state(bool search, int context)
+{
+    auto& state = m_start_states[search][context];
+    if (state < 0)
+        state = get_state({{search ? (uint16_t)0 : CompiledRegex::search_prefix_size}, context});
+    return state;
+}
+
+bool RegexDFA::matches_at_end(const CompiledRegex& program, StateIndex state)
+{
+    if (m_states[state].matches_at_end < 0)
+        m_states[state].matches_at_end = compute_transition(program, state, 0, true).matched;
+    return m_states[state].matches_at_end;
+}
+
+RegexDFA::Transition RegexDFA::other_transition(const CompiledRegex& program, StateIndex state, Codepoint cp)
+{
+    auto key = std::make_pair(state, cp);
+    auto it = m_other_transitions.find(key);
+    if (it != m_other_transitions.end())
+        return decode(it->value);
+
+    auto transition = compute_transition(program, state, cp, false);
+    if (transition.next != too_big)
+        m_other_transitions.insert({key, encode(transition)});
+    return transition;
+}
+
+RegexDFA::Transition RegexDFA::compute_transition(const CompiledRegex& program, StateIndex state,
+                                                  Codepoint cp, bool at_end)
+{
+    if (++m_generation == 0)
+    {
+        std::fill(m_visited.begin(), m_visited.end(), 0);
+        m_generation = 1;
+    }
+
+    const int context = m_states[state].key.context;
+    const bool word_boundary = (context & FixedWordBoundary) ? (context & PrevWord) != 0 :
+        at_end ? not (context & NotEndOfWord) : ((context & PrevWord) != 0) != is_word(cp);
+
+    // Follow the instructions like the VM does for each thread, stopping at
+    // the ones consuming a codepoint
+    Vector<uint16_t, MemoryDomain::Regex> pending = m_states[state].key.instructions;
+    StateKey next{{}, (cp == '\n' ? LineStart : 0) | (is_word(cp) ? PrevWord : 0) |
+                      (context & (NotEndOfLine | NotEndOfWord))};
+    bool matched = false;
+    while (not pending.empty())
+    {
+        const uint16_t index = pending.back();
+        pending.pop_back();
+        if (m_visited[index] == m_generation)
+            continue;
+        m_visited[index] = m_generation;
+
+        auto consume_if = [&](bool accept) {
+            // after the search prefix start character, threads are the same as at its start
+            if (accept and not at_end)
+                next.instructions.push_back(index == CompiledRegex::search_prefix_size - 2 ? 0 : index + 1);
+        };
+        auto continue_if = [&](bool accept) {
+            if (accept)
+                pending.push_back(index + 1);
+        };
+
+        const auto& inst = program.instructions[index];
+        switch (inst.op)
+        {
+            case CompiledRegex::Literal: consume_if(inst.param == cp); break;
+            case CompiledRegex::Literal_IgnoreCase: consume_if(inst.param == to_lower(cp)); break;
+            case CompiledRegex::AnyChar:
+            case CompiledRegex::FindNextStart: consume_if(true); break;
+            case CompiledRegex::Matcher: consume_if(not at_end and program.character_classes[inst.param].matches(cp)); break;
+            case CompiledRegex::LiteralSwitch:
+                if (auto* target = at_end ? nullptr : program.literal_switches[inst.param].target(cp))
+                    next.instructions.push_back(*target);
+                break;
+            case CompiledRegex::Jump: pending.push_back(inst.param); break;
+            case CompiledRegex::Split_PrioritizeParent:
+            case CompiledRegex::Split_PrioritizeChild:
+                pending.push_back(index + 1);
+                pending.push_back(inst.param);
+                break;
+            case CompiledRegex::Save: continue_if(true); break;
+            case CompiledRegex::LineStart: continue_if(context & LineStart); break;
+            case CompiledRegex::LineEnd: continue_if(at_end ? not (context & NotEndOfLine) : cp == '\n'); break;
+            case CompiledRegex::WordBoundary: continue_if(word_boundary); break;
+            case CompiledRegex::NotWordBoundary: continue_if(not word_boundary); break;
+            case CompiledRegex::SubjectBegin: continue_if(context & SubjectBegin); break;
+            case CompiledRegex::SubjectEnd: continue_if(at_end); break;
+            case CompiledRegex::Match: matched = true; break;
+            default: kak_assert(false); // lookarounds
+        }
+    }
+
+    if (at_end or next.instructions.empty())
+        return {failed, matched};
+
+    std::sort(next.instructions.begin(), next.instructions.end());
+    next.instructions.erase(std::unique(next.instructions.begin(), next.instructions.end()),
+                            next.instructions.end());
+    return {get_state(std::move(next)), matched};
+}
+
+RegexDFA::StateIndex RegexDFA::get_state(StateKey key)
+{
+    auto it = m_state_indices.find(key);
+    if (it != m_state_indices.end())
+        return it->value;
+
+    if (m_states.size() == m_max_states)
+    {
+        // the program is not suited to a DFA, let the VM handle it
+        m_enabled = false;
+        m_states.clear();
+        m_state_indices.clear();
+        m_other_transitions.clear();
+        return too_big;
+    }
+
+    const StateIndex index = (StateIndex)m_states.size();
+    m_states.emplace_back();
+    auto& state = m_states.back();
+    state.key = key;
+    state.idle = key.instructions.size() == 1 and key.instructions[0] == 0;
+    std::fill(std::begin(state.transitions), std::end(state.transitions), -1);
+    m_state_indices.insert({std::move(key), index});
+    return index;
+}
+
+namespace
+{
+thread_local RegexInterrupt* current_interrupt = nullptr;
+constexpr std::chrono::milliseconds interrupt_check_period{10};
+}
+
+RegexInterrupt::RegexInterrupt(Check check)
+    : m_check{std::move(check)}, m_previous{current_interrupt}, m_next_check{Clock::now()}
+{
+    current_interrupt = this;
+}
+
+RegexInterrupt::RegexInterrupt(const RegexInterrupt* parent)
+    : m_parent{parent}, m_previous{current_interrupt}
+{
+    current_interrupt = this;
+}
+
+RegexInterrupt::~RegexInterrupt()
+{
+    kak_assert(current_interrupt == this);
+    current_interrupt = m_previous;
+}
+
+const RegexInterrupt* RegexInterrupt::current()
+{
+    return current_interrupt;
+}
+
+void RegexInterrupt::poll()
+{
+    RegexInterrupt* interrupt = current_interrupt;
+    if (not interrupt)
+        return;
+
+    if (interrupt->m_parent)
+    {
+        if (interrupt->m_parent->interrupted())
+            interrupt->m_interrupted = true;
+    }
+    else if (interrupt->m_check and not interrupt->m_interrupted and
+             Clock::now() >= interrupt->m_next_check)
+    {
+        // set first, so that executions made by the check do not call it again
+        interrupt->m_next_check = TimePoint::max();
+        const bool interrupted = interrupt->m_check();
+        interrupt->m_next_check = Clock::now() + interrupt_check_period;
+        interrupt->m_interrupted = interrupted;
+    }
+
+    if (interrupt->m_interrupted)
+        throw regex_aborted{};
+}
+
 namespace
 {
 template<MatchDirection dir = MatchDirection::Forward>
@@ -1302,6 +1924,22 @@ auto test_regex = UnitTest{[]{
         kak_assert(vm.exec("abc"));
     }
 
+    {
+        TestVM<> vm{R"([\h\d]+[^\s\d_]+[à-ÿ]\H)"};
+        kak_assert(vm.exec("\t 4aZé\n"));
+        kak_assert(vm.exec(" 3éèéx"));
+        kak_assert(not vm.exec(" 3a_éx"));
+        kak_assert(not vm.exec(" 3aÀx"));
+        kak_assert(not vm.exec(" 3aé\t"));
+    }
+
+    {
+        TestVM<> vm{R"((?i)[^a-cX]{3})"};
+        kak_assert(vm.exec("dYé"));
+        kak_assert(not vm.exec("dyB"));
+        kak_assert(not vm.exec("xdy"));
+    }
+
     {
         TestVM<> vm{R"((?:foo)+)"};
         kak_assert(vm.exec("foofoofoo"));
@@ -1403,6 +2041,391 @@ auto test_regex = UnitTest{[]{
         const char str[] = "\0\n☎☏"; // work around the null byte in the literal
         kak_assert(vm.exec({str, str + sizeof(str)-1}));
     }
+
+    {
+        TestVM<> vm{R"(\bfoo_bar\w+\()"};
+        kak_assert(vm.required_literal->value == "foo_bar" and vm.required_literal->offset == 0);
+        kak_assert(vm.exec("call foo_bar foo_barbaz(x)", RegexExecFlags::Search));
+        kak_assert(StringView{vm.captures()[0], vm.captures()[1]} == "foo_barbaz(");
+        kak_assert(not vm.exec("foo_bar( xfoo_barz(", RegexExecFlags::Search));
+    }
+
+    {
+        TestVM<> vm{R"(\w+_bar\()"};
+        kak_assert(vm.required_literal->value == "_bar(" and vm.required_literal->offset == -1);
+        kak_assert(vm.exec("a_bar _bar qux_bar(", RegexExecFlags::Search));
+        kak_assert(StringView{vm.captures()[0], vm.captures()[1]} == "qux_bar(");
+        kak_assert(not vm.exec("qux_bar qux_bar", RegexExecFlags::Search));
+    }
+
+    {
+        TestVM<> vm{R"(ab(cd)?efgh)"};
+        kak_assert(vm.required_literal->value == "efgh" and vm.required_literal->offset == -1);
+        kak_assert(vm.exec("abcdxabefgh", RegexExecFlags::Search));
+        kak_assert(StringView{vm.captures()[0], vm.captures()[1]} == "abefgh");
+    }
+
+    {
+        TestVM<> vm{R"(.é_(foo)\Kbar)"};
+        kak_assert(vm.required_literal->value == "é_foobar" and vm.required_literal->offset == 1);
+        kak_assert(vm.exec("aaéé_foobar", RegexExecFlags::Search));
+        kak_assert(StringView{vm.captures()[0], vm.captures()[1]} == "bar");
+        kak_assert(not vm.exec("é_foobar", RegexExecFlags::Search));
+    }
+
+    kak_assert(not TestVM<>{R"((?i)foobar)"}.required_literal);
+    kak_assert(not TestVM<>{R"(foo|bar)"}.required_literal);
+    kak_assert(not TestVM<MatchDirection::Backward>{R"(foobar)"}.required_literal);
+
+    {
+        TestVM<> vm{R"(foo\.bar)"};
+        kak_assert(vm.literal_pattern->value == "foo.bar" and not vm.literal_pattern->ignore_case);
+        const char str[] = "fooxbar foo.barfoo.bar";
+        kak_assert(vm.exec(str, RegexExecFlags::Search));
+        kak_assert(vm.captures()[0] == str + 8 and vm.captures()[1] == str + 15);
+        kak_assert(vm.exec("foo.bar"));
+        kak_assert(not vm.exec("foo.barx"));
+        kak_assert(not vm.exec("foo.ba", RegexExecFlags::Search));
+    }
+
+    {
+        TestVM<MatchDirection::Backward> vm{"aa"};
+        kak_assert(vm.literal_pattern);
+        const char str[] = "aaa b aaa";
+        kak_assert(vm.exec(str, RegexExecFlags::Search));
+        kak_assert(vm.captures()[0] == str + 7 and vm.captures()[1] == str + 9);
+    }
+
+    {
+        TestVM<> vm{R"((?i)FoO)"};
+        kak_assert(vm.literal_pattern->value == "foo" and vm.literal_pattern->ignore_case);
+        kak_assert(vm.exec("éfOO", RegexExecFlags::Search));
+        kak_assert(StringView{vm.captures()[0], vm.captures()[1]} == "fOO");
+    }
+
+    {
+        TestVM<> vm{R"(\bfoo\b)"};
+        kak_assert(vm.literal_pattern->word_start and vm.literal_pattern->word_end);
+        const char str[] = "foobar afoo foo_ foo.";
+        kak_assert(vm.exec(str, RegexExecFlags::Search));
+        kak_assert(vm.captures()[0] == str + 17);
+        kak_assert(not vm.exec("foo", RegexExecFlags::Search | RegexExecFlags::NotBeginOfWord));
+        kak_assert(not vm.VMType::exec(str + 8, str + 11, RegexExecFlags::Search | RegexExecFlags::PrevAvailable));
+    }
+
+    kak_assert(not TestVM<>{R"(fo+)"}.literal_pattern);
+    kak_assert(not TestVM<>{R"(foo|bar)"}.literal_pattern);
+    kak_assert(not TestVM<>{R"((foo))"}.literal_pattern);
+    kak_assert(not TestVM<>{R"(foo(?i)bar)"}.literal_pattern);
+    kak_assert(not TestVM<>{R"((?i)éa)"}.literal_pattern);
+    kak_assert(not TestVM<>{R"(\bfoo\bbar)"}.literal_pattern);
+    kak_assert(not TestVM<MatchDirection::Backward>{R"(\bfoo)"}.literal_pattern);
+
+    {
+        // literal patterns match the same as the program would
+        auto check = [](StringView re, auto dir) {
+            TestVM<decltype(dir)::value> fast{re}, slow{re};
+            kak_assert(fast.literal_pattern);
+            slow.literal_pattern.reset();
+            for (StringView subject : {"", "ab", "xabyab", "AbaB", "ab_ab ab", "a\nb\nab\n", "éAB"})
+            {
+                for (auto flags : {RegexExecFlags::None, RegexExecFlags::Search,
+                                   RegexExecFlags::Search | RegexExecFlags::NotBeginOfWord | RegexExecFlags::NotEndOfWord})
+                {
+                    kak_assert(fast.exec(subject, flags) == slow.exec(subject, flags));
+                    kak_assert(fast.captures() == slow.captures());
+                }
+            }
+        };
+        using Forward = std::integral_constant<MatchDirection, MatchDirection::Forward>;
+        using Backward = std::integral_constant<MatchDirection, MatchDirection::Backward>;
+        for (auto re : {"ab", "(?i)ab", R"(\bab)", R"(ab\b)", R"((?i)\bab\b)"})
+            check(re, Forward{});
+        check("ab", Backward{});
+        check("(?i)ab", Backward{});
+    }
+
+    {
+        // the DFA tells the same as the VM
+        const auto no_captures = RegexExecFlags::AnyMatch | RegexExecFlags::NoSaves;
+        for (auto re : {"a*b", "^foo$", R"(\bfo+\b)", "(a|b)*c", R"(\Aab)", R"(ab\z)", R"([a-z]+\d)",
+                        "é+", "(?i)fO+", R"(\Bo)", ".*", "x?", "^$", R"(\w+\s\w+)"})
+        {
+            TestVM<> vm{re};
+            TestVM<MatchDirection::Backward> backward{re};
+            TestVM<> anchored{format(R"(\A(?:{})\z)", re)};
+            for (auto subject : {"", "b", "aab", "foo", "foo\nbar", " foo ", "xfoox", "abc", "ab1",
+                                 "ééé", "FOO", "b\nc\n", "foo bar"})
+            {
+                for (auto flags : {RegexExecFlags::None, RegexExecFlags::NotBeginOfLine, RegexExecFlags::NotEndOfLine,
+                                   RegexExecFlags::NotBeginOfWord, RegexExecFlags::NotEndOfWord,
+                                   RegexExecFlags::NotInitialNull})
+                {
+                    const auto search = flags | RegexExecFlags::Search;
+                    kak_assert(vm.exec(subject, search | no_captures) == vm.exec(subject, search));
+                    kak_assert(backward.exec(subject, search | no_captures) == backward.exec(subject, search));
+                    kak_assert(vm.exec(subject, flags | no_captures) == anchored.exec(subject, search));
+                    kak_assert(vm.exec(subject, flags) == anchored.exec(subject, search));
+                }
+                const auto flags = RegexExecFlags::Search | RegexExecFlags::NotBeginOfSubject;
+                kak_assert(vm.exec(subject, flags | no_captures) == vm.exec(subject, flags));
+            }
+            kak_assert(vm.dfa()->enabled());
+        }
+
+        kak_assert(not TestVM<>{"(?=a)"}.dfa());
+        TestVM<> lookaround{"a(?=b)"};
+        kak_assert(lookaround.exec("ab", RegexExecFlags::Search | no_captures));
+        kak_assert(not lookaround.dfa()->enabled());
+
+        TestVM<> exponential{"(a|b)*a(a|b){12}c"};
+        // a small state limit is reached without building thousands of states
+        exponential.give_back_dfa(std::make_unique<RegexDFA>(exponential, 64));
+        String subject;
+        uint32_t seed = 42;
+        for (int i = 0; i < 1000; ++i)
+            subject.push_back(((seed = seed * 1103515245 + 12345) >> 16) & 1 ? 'a' : 'b');
+        kak_assert(not exponential.exec(subject, RegexExecFlags::Search | no_captures));
+        kak_assert(not exponential.dfa()->enabled());
+        kak_assert(exponential.exec(subject + "abbbbbbbbbbbbc", RegexExecFlags::Search | no_captures));
+    }
+
+    {
+        TestVM<> vm{R"(\b(for|foreach|do|done|while)\b)"};
+        kak_assert(vm.literal_switches.size() == 1);
+        kak_assert(vm.exec("foreach", RegexExecFlags::None));
+        kak_assert(vm.exec("done", RegexExecFlags::None));
+        kak_assert(not vm.exec("fore", RegexExecFlags::None));
+        kak_assert(vm.exec("whiles do", RegexExecFlags::Search));
+        kak_assert(StringView{vm.captures()[2], vm.captures()[3]} == "do");
+    }
+
+    {
+        // alternatives that are prefixes of others keep their priority
+        TestVM<> shorter_first{"foo|foobar"};
+        kak_assert(shorter_first.exec("foobar", RegexExecFlags::Search));
+        kak_assert(StringView{shorter_first.captures()[0], shorter_first.captures()[1]} == "foo");
+        TestVM<> longer_first{"foobar|foo"};
+        kak_assert(longer_first.exec("foobar", RegexExecFlags::Search));
+        kak_assert(StringView{longer_first.captures()[0], longer_first.captures()[1]} == "foobar");
+        // after the first one, alternatives are tried from the last to the second
+        TestVM<> mixed{"foobar|fooba|foo|foob|fox"};
+        kak_assert(mixed.literal_switches.size() == 1);
+        kak_assert(mixed.exec("foobar", RegexExecFlags::Search));
+        kak_assert(StringView{mixed.captures()[0], mixed.captures()[1]} == "foobar");
+        kak_assert(mixed.exec("fooba", RegexExecFlags::Search));
+        kak_assert(StringView{mixed.captures()[0], mixed.captures()[1]} == "foob");
+        kak_assert(mixed.exec("foo", RegexExecFlags::Search));
+        kak_assert(StringView{mixed.captures()[0], mixed.captures()[1]} == "foo");
+    }
+
+    {
+        // tries match the same as plain alternations
+        const StringView words[] = {"i", "foreach", "do", "done", "fore", "while", "if", "dom", "for", "forea"};
+        String trie_re, plain_re;
+        for (auto& word : words)
+        {
+            trie_re += format("{}{}", trie_re.empty() ? "" : "|", word);
+            plain_re += format("{}(?:{}){}", plain_re.empty() ? "" : "|", word.substr(0, 1_byte), word.substr(1_byte));
+        }
+        auto check = [&](auto dir, StringView prefix) {
+            TestVM<decltype(dir)::value> trie{prefix + trie_re}, plain{prefix + plain_re};
+            kak_assert(not trie.literal_switches.empty() and plain.literal_switches.empty());
+            for (auto subject : {"foreach done", "do", "whiles", "ifor", "I", "DOMINO", "xfo", "dondone", "forea", "fore", "foreac"})
+            {
+                kak_assert(trie.exec(subject, RegexExecFlags::Search) == plain.exec(subject, RegexExecFlags::Search));
+                kak_assert(trie.captures() == plain.captures());
+                kak_assert(trie.exec(subject, RegexExecFlags::None) == plain.exec(subject, RegexExecFlags::None));
+            }
+        };
+        using Forward = std::integral_constant<MatchDirection, MatchDirection::Forward>;
+        using Backward = std::integral_constant<MatchDirection, MatchDirection::Backward>;
+        check(Forward{}, "");
+        check(Forward{}, "(?i)");
+        check(Backward{}, "");
+        check(Backward{}, "(?i)");
+    }
+
+    {
+        const std::string str = "abcabdab";
+        kak_assert(find_literal(str.begin(), str.end(), "abd") == str.begin() + 3);
+        kak_assert(find_literal(str.begin(), str.end(), "abx") == str.end());
+        kak_assert(find_literal(str.begin(), str.end(), "abc") == str.begin());
+        kak_assert(find_literal(str.begin(), str.end(), "bx") == str.end());
+        int polls = 0;
+        auto poll = [&](int count) { polls += count; };
+        kak_assert(find_literal(str.begin(), str.end(), "ab", str.begin() + 2, poll) == str.begin());
+        kak_assert(find_literal(str.begin() + 1, str.end(), "ab", str.begin() + 2, poll) == str.end());
+        kak_assert(find_literal(str.begin() + 1, str.end(), "ab", str.begin() + 3, poll) == str.begin() + 3);
+        kak_assert(find_literal(str.c_str() + 1, str.c_str() + str.size(), "ab", str.c_str() + 2, poll) == str.c_str() + str.size());
+        kak_assert(find_literal(str.c_str() + 1, str.c_str() + str.size(), "abd", str.c_str() + 3, poll) == str.c_str() + 3);
+        kak_assert(polls > 0);
+    }
+
+    {
+        // matches start at or before last_start, but can end after it
+        auto check = [](StringView re, StringView subject, int last_start, int begin, int end) {
+            TestVM<> vm{re};
+            const bool matched = vm.VMType::exec(subject.begin(), subject.begin() + last_start, subject.end(),
+                                                 RegexExecFlags::Search);
+            kak_assert(matched == (begin >= 0));
+            kak_assert(not matched or (vm.captures()[0] == subject.begin() + begin and
+                                       vm.captures()[1] == subject.begin() + end));
+        };
+        check(R"(\w+)", "ab cd ef", 1, 0, 2);
+        check(R"(\s\w+)", "ab cd ef", 1, -1, -1);
+        check(R"(\s\w+)", "ab cd ef", 2, 2, 5);
+        check(R"([cd]+)", "ab cd ef", 3, 3, 5);
+        check(R"(fo+b)", "a fooob", 1, -1, -1);
+        check(R"(fo+b)", "a fooob", 2, 2, 7);
+        check(R"(foo)", "xx foo foo", 2, -1, -1);
+        check(R"(foo)", "xx foo foo", 3, 3, 6);
+        check(R"((?i)foo)", "xx FOO foo", 2, -1, -1);
+        check(R"((?i)foo)", "xx FOO foo", 3, 3, 6);
+        check(R"(\d|x$)", "ab\nx", 2, -1, -1);
+        check(R"(\d|x$)", "ab\nx", 3, 3, 4);
+    }
+}};
+
+auto test_regex_concurrent_execution = UnitTest{[]{
+    // VMs on several threads run the same programs, in each direction and
+    // with or without the DFA, and find the same matches as a single one
+    String subject;
+    for (int i = 0; i < 8; ++i)
+        subject += format("line {} foo{}bar {}\n", i, String('o', CharCount{i % 7}), i % 3 ? "baz" : "qux");
+
+    const StringView regexes[] = {R"((fo+)(b[a-z]r)\s(?=qux))", R"(\b(?:foo|fooo|line)\b)", R"(\d+\s\w+$)", "o{3,5}b"};
+    const RegexExecFlags flags[] = {RegexExecFlags::Search,
+                                    RegexExecFlags::Search | RegexExecFlags::AnyMatch | RegexExecFlags::NoSaves};
+
+    struct Program
+    {
+        CompiledRegex regex;
+        MatchDirection direction;
+        Vector<Vector<const char*>> expected; // for each flags, the captures of each match
+    };
+    Vector<Program> programs;
+    for (auto& re : regexes)
+    {
+        for (auto direction : {MatchDirection::Forward, MatchDirection::Backward})
+            programs.push_back({compile_regex(re, RegexCompileFlags::None, direction), direction, {}});
+    }
+
+    auto find_all = [&](const Program& program, RegexExecFlags flags) {
+        Vector<const char*> res;
+        auto collect = [&](auto& vm) {
+            if (flags & RegexExecFlags::NoSaves) // lines that match
+            {
+                const char* subject_end = subject.end();
+                for (const char* line = subject.begin(); line != subject_end; )
+                {
+                    const char* line_end = std::find(line, subject_end, '\n') + 1;
+                    if (vm.exec(line, line_end, flags))
+                        res.push_back(line);
+                    line = line_end;
+                }
+                return;
+            }
+            const char* begin = subject.begin();
+            const char* end = subject.end();
+            while (begin != end and vm.exec(begin, end, flags | (begin != subject.begin() ? RegexExecFlags::PrevAvailable
+                                                                                         : RegexExecFlags::None)))
+            {
+                res.insert(res.end(), vm.captures().begin(), vm.captures().end());
+                if (program.direction == MatchDirection::Forward)
+                    begin = std::max(vm.captures()[1], begin + 1);
+                else
+                    end = vm.captures()[0];
+            }
+        };
+        if (program.direction == MatchDirection::Forward)
+        {
+            ThreadedRegexVM<const char*, MatchDirection::Forward> vm{program.regex};
+            collect(vm);
+        }
+        else
+        {
+            ThreadedRegexVM<const char*, MatchDirection::Backward> vm{program.regex};
+            collect(vm);
+        }
+        return res;
+    };
+
+    for (auto& program : programs)
+    {
+        for (auto& f : flags)
+            program.expected.push_back(find_all(program, f));
+    }
+
+    constexpr int thread_count = 4;
+    bool ok[thread_count] = {};
+    WorkerAllocations allocations[thread_count];
+    Vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&, t] {
+            allocations[t].count_on_this_thread();
+            ok[t] = true;
+            for (auto& program : programs)
+            {
+                for (int f = 0; f < 2; ++f)
+                    ok[t] = ok[t] and find_all(program, flags[f]) == program.expected[f];
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    for (int t = 0; t < thread_count; ++t)
+        kak_assert(ok[t]);
+    kak_assert(not programs[0].expected[0].empty() and not programs[3].expected[1].empty());
+}};
+
+auto test_regex_interrupt = UnitTest{[]{
+    // a bit longer than the polling interval of executions
+    const String subject(Codepoint{'a'}, CharCount{5000});
+    // literal scan, start chars scan and program, DFA
+    const std::pair<StringView, RegexExecFlags> executions[] = {
+        {"a*b", RegexExecFlags::Search},
+        {"a*[bc]", RegexExecFlags::Search},
+        {"a*[bc]", RegexExecFlags::Search | RegexExecFlags::AnyMatch | RegexExecFlags::NoSaves}
+    };
+    auto aborts = [&](StringView re, RegexExecFlags flags) {
+        TestVM<> vm{re};
+        try
+        {
+            vm.exec(subject, flags);
+        }
+        catch (regex_aborted&)
+        {
+            return true;
+        }
+        return false;
+    };
+
+    for (auto& exec : executions)
+    {
+        int checks = 0;
+        {
+            RegexInterrupt interrupt{[&] { ++checks; return false; }};
+            kak_assert(not aborts(exec.first, exec.second));
+        }
+        kak_assert(checks > 0);
+
+        RegexInterrupt interrupt{[] { return true; }};
+        kak_assert(aborts(exec.first, exec.second) and interrupt.interrupted());
+
+        // worker threads stop along with the interrupt they were given
+        bool worker_aborted = false;
+        WorkerAllocations allocations;
+        std::thread worker{[&] {
+            allocations.count_on_this_thread();
+            RegexInterrupt worker_interrupt{&interrupt};
+            worker_aborted = aborts(exec.first, exec.second);
+        }};
+        worker.join();
+        kak_assert(worker_aborted);
+    }
+    kak_assert(not RegexInterrupt::current() and not aborts("a*b", RegexExecFlags::Search));
 }};
 
 }
@@ -1,14 +1,22 @@
 #ifndef regex_impl_hh_INCLUDED
 #define regex_impl_hh_INCLUDED
 
+#include "clock.hh"
 #include "exception.hh"
 #include "flags.hh"
+#include "hash_map.hh"
 #include "ref_ptr.hh"
+#include "string.hh"
 #include "unicode.hh"
 #include "utf8.hh"
 #include "utf8_iterator.hh"
 #include "vector.hh"
 
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <typeinfo>
+
 namespace Kakoune
 {
 
@@ -17,12 +25,206 @@ struct regex_error : runtime_error
     using runtime_error::runtime_error;
 };
 
+struct regex_aborted : runtime_error
+{
+    regex_aborted() : runtime_error{"search aborted"} {}
+};
+
+// Lets long regex executions be stopped: they regularly poll the interrupt
+// of their thread, and throw regex_aborted once it is interrupted.
+//
+// An interrupt is the current one of the thread creating it while it
+// lives. Its check is called at most every few milliseconds, so that it
+// can look at user input, and interrupts when it returns true. Interrupts
+// made from a parent one, on worker threads, are interrupted along with it.
+class RegexInterrupt
+{
+public:
+    using Check = std::function<bool ()>;
+
+    explicit RegexInterrupt(Check check);
+    explicit RegexInterrupt(const RegexInterrupt* parent);
+    RegexInterrupt(const RegexInterrupt&) = delete;
+    RegexInterrupt& operator=(const RegexInterrupt&) = delete;
+    ~RegexInterrupt();
+
+    static const RegexInterrupt* current();
+    bool interrupted() const { return m_interrupted; }
+
+    // throws regex_aborted when the current interrupt is interrupted
+    static void poll();
+
+private:
+    Check m_check;
+    const RegexInterrupt* m_parent = nullptr;
+    RegexInterrupt* m_previous;
+    TimePoint m_next_check;
+    std::atomic<bool> m_interrupted{false};
+};
+
 enum class MatchDirection
 {
     Forward,
     Backward
 };
 
+struct CompiledRegex;
+
+// Set of codepoints described by a character class such as [a-z_] or an
+// escape such as \w. Membership of ascii codepoints is precomputed in a
+// bitmap, case folding included, others are looked up in sorted ranges.
+struct CharacterClass
+{
+    struct Range { Codepoint min, max; };
+
+    // sorted and merged, lower case when ignore_case
+    Vector<Range, MemoryDomain::Regex> ranges;
+    Vector<std::pair<wctype_t, bool>, MemoryDomain::Regex> ctypes;
+    // codepoints matched by anything else if not empty
+    Vector<Codepoint, MemoryDomain::Regex> excluded;
+    bool negative = false;
+    bool ignore_case = false;
+
+    // must be called once the members above are set
+    void compute_ascii();
+
+    bool matches(Codepoint cp) const
+    {
+        if (cp < 128)
+            return (m_ascii[cp / 64] >> (cp % 64)) & 1;
+        return matches_slow(cp);
+    }
+
+private:
+    bool matches_slow(Codepoint cp) const;
+
+    uint64_t m_ascii[2] = {};
+};
+
+// Deterministic automaton simulating a compiled program, built lazily while
+// running it. It tells whether a subject matches much faster than the VM,
+// as it neither tracks threads nor captures.
+//
+// Its states are the sets of instructions the VM threads would be at, along
+// with a context describing the previous codepoint. It does not support
+// lookarounds, and disables itself when the program needs too many states.
+class RegexDFA : public UseMemoryDomain<MemoryDomain::Regex>
+{
+public:
+    using StateIndex = int;
+    static constexpr StateIndex failed = -1; // no thread left
+    static constexpr StateIndex too_big = -2;
+
+    enum Context : int
+    {
+        LineStart         = 1 << 0,
+        SubjectBegin      = 1 << 1,
+        PrevWord          = 1 << 2,
+        // word boundary does not depend on the next codepoint, PrevWord is its value
+        FixedWordBoundary = 1 << 3,
+        NotEndOfLine      = 1 << 4,
+        NotEndOfWord      = 1 << 5,
+    };
+
+    struct Transition
+    {
+        StateIndex next;
+        // the program matched before consuming the codepoint
+        bool matched;
+    };
+
+    static constexpr size_t default_max_states = 2048;
+    explicit RegexDFA(const CompiledRegex& program, size_t max_states = default_max_states);
+
+    bool enabled() const { return m_enabled; }
+    bool is_idle(StateIndex state) const { return m_states[state].idle; }
+
+    // searches start at the search prefix, whose idle state skips codepoints
+    StateIndex start_state(bool search, int context);
+
+    Transition step(const CompiledRegex& program, StateIndex state, Codepoint cp)
+    {
+        if (cp < ascii_count)
+        {
+            int transition = m_states[state].transitions[cp];
+            if (transition < 0)
+            {
+                // computing it can add states, invalidating references to them
+                auto computed = compute_transition(program, state, cp, false);
+                if (computed.next == too_big)
+                    return computed;
+                m_states[state].transitions[cp] = transition = encode(computed);
+            }
+            return decode(transition);
+        }
+        return other_transition(program, state, cp);
+    }
+
+    bool matches_at_end(const CompiledRegex& program, StateIndex state);
+
+private:
+    static constexpr int ascii_count = 128;
+    static constexpr int context_count = 1 << 6;
+
+    struct StateKey
+    {
+        Vector<uint16_t, MemoryDomain::Regex> instructions;
+        int context;
+
+        friend bool operator==(const StateKey& lhs, const StateKey& rhs)
+        {
+            return lhs.context == rhs.context and lhs.instructions == rhs.instructions;
+        }
+
+        friend size_t hash_value(const StateKey& key)
+        {
+            return combine_hash(hash_data(reinterpret_cast<const char*>(key.instructions.data()),
+                                          key.instructions.size() * sizeof(uint16_t)),
+                                key.context);
+        }
+    };
+
+    struct State
+    {
+        StateKey key;
+        bool idle;
+        int8_t matches_at_end = -1;
+        // encoded transitions on ascii codepoints, -1 when not computed yet
+        int transitions[ascii_count];
+    };
+
+    static int encode(Transition transition) { return (transition.next + 1) * 2 + transition.matched; }
+    static Transition decode(int transition) { return {transition / 2 - 1, (transition & 1) != 0}; }
+
+    Transition other_transition(const CompiledRegex& program, StateIndex state, Codepoint cp);
+    Transition compute_transition(const CompiledRegex& program, StateIndex state, Codepoint cp, bool at_end);
+    StateIndex get_state(StateKey key);
+
+    size_t m_max_states;
+    Vector<State, MemoryDomain::Regex> m_states;
+    StateIndex m_start_states[2][context_count];
+    HashMap<StateKey, StateIndex, MemoryDomain::Regex> m_state_indices;
+    HashMap<std::pair<StateIndex, Codepoint>, int, MemoryDomain::Regex> m_other_transitions;
+    Vector<uint16_t, MemoryDomain::Regex> m_visited;
+    uint16_t m_generation = 0;
+    bool m_enabled;
+};
+
+// Base of the VMs that programs keep idle for reuse, see CompiledRegex::take_vm
+struct RegexVMBase : UseMemoryDomain<MemoryDomain::Regex>
+{
+    virtual ~RegexVMBase() = default;
+};
+
+// Counts of the VM allocations, reported by the debug regex command
+struct RegexVMStats
+{
+    std::atomic<size_t> vms_built{0};
+    std::atomic<size_t> vms_reused{0};
+    std::atomic<size_t> saves_allocated{0};
+};
+extern RegexVMStats regex_vm_stats;
+
 struct CompiledRegex : RefCountable, UseMemoryDomain<MemoryDomain::Regex>
 {
     enum Op : char
@@ -33,6 +235,7 @@ struct CompiledRegex : RefCountable, UseMemoryDomain<MemoryDomain::Regex>
         Literal_IgnoreCase,
         AnyChar,
         Matcher,
+        LiteralSwitch,
         Jump,
         Split_PrioritizeParent,
         Split_PrioritizeChild,
@@ -56,9 +259,6 @@ struct CompiledRegex : RefCountable, UseMemoryDomain<MemoryDomain::Regex>
     struct Instruction
     {
         Op op;
-        // Those mutables are used during execution
-        mutable bool scheduled;
-        mutable uint16_t last_step;
         uint32_t param;
     };
     static_assert(sizeof(Instruction) == 8, "");
@@ -68,8 +268,27 @@ struct CompiledRegex : RefCountable, UseMemoryDomain<MemoryDomain::Regex>
     explicit operator bool() const { return not instructions.empty(); }
 
     Vector<Instruction, MemoryDomain::Regex> instructions;
-    Vector<std::function<bool (Codepoint)>, MemoryDomain::Regex> matchers;
+    Vector<CharacterClass, MemoryDomain::Regex> character_classes;
     Vector<Codepoint, MemoryDomain::Regex> lookarounds;
+
+    // Alternations of literals are compiled as a trie, whose nodes consume a
+    // codepoint and jump to the instructions of the matching child
+    struct Switch
+    {
+        // sorted by codepoint
+        Vector<std::pair<Codepoint, uint32_t>, MemoryDomain::Regex> targets;
+        bool ignore_case;
+
+        const uint32_t* target(Codepoint cp) const
+        {
+            if (ignore_case)
+                cp = to_lower(cp);
+            auto it = std::lower_bound(targets.begin(), targets.end(), cp,
+                                       [](auto& target, Codepoint cp) { return target.first < cp; });
+            return (it != targets.end() and it->first == cp) ? &it->second : nullptr;
+        }
+    };
+    Vector<Switch, MemoryDomain::Regex> literal_switches;
     MatchDirection direction;
     size_t save_count;
 
@@ -81,6 +300,48 @@ struct CompiledRegex : RefCountable, UseMemoryDomain<MemoryDomain::Regex>
     };
 
     std::unique_ptr<StartChars> start_chars;
+
+    // Literal text that every match contains, searched for before running
+    // the program to skip the parts of the subject that cannot match
+    struct RequiredLiteral
+    {
+        String value;
+        // codepoints between the match start and the literal, -1 if variable
+        int offset;
+    };
+
+    std::unique_ptr<RequiredLiteral> required_literal;
+
+    // Set when the regex only matches a literal string, optionally between
+    // word boundaries, which is then searched for without running the program
+    struct LiteralPattern
+    {
+        // lowercase ascii when ignore_case
+        String value;
+        bool ignore_case;
+        bool word_start;
+        bool word_end;
+    };
+
+    std::unique_ptr<LiteralPattern> literal_pattern;
+
+    // A DFA is built lazily while running the program. VMs take one for
+    // their whole lifetime and give it back when destroyed, so that VMs
+    // running the program concurrently on other threads use another one.
+    std::unique_ptr<RegexDFA> take_dfa() const;
+    void give_back_dfa(std::unique_ptr<RegexDFA> dfa) const;
+
+    mutable Vector<std::unique_ptr<RegexDFA>, MemoryDomain::Regex> idle_dfas;
+
+    // VMs are kept as well once their executions are done, along with
+    // their state vectors and saves, so that the many short searches made
+    // by highlighters and hooks do not allocate them again. take_vm returns
+    // an idle VM of the given type, or null. Declared after idle_dfas, as
+    // idle VMs give their DFA back when destroyed.
+    std::unique_ptr<RegexVMBase> take_vm(const std::type_info& type) const;
+    void give_back_vm(std::unique_ptr<RegexVMBase> vm) const;
+
+    mutable Vector<std::unique_ptr<RegexVMBase>, MemoryDomain::Regex> idle_vms;
 };
 
 enum class RegexCompileFlags
@@ -110,14 +371,190 @@ enum class RegexExecFlags
 
 constexpr bool with_bit_ops(Meta::Type<RegexExecFlags>) { return true; }
 
+namespace detail
+{
+template<typename Iterator>
+auto contiguous_bytes(const Iterator& it, const Iterator& end, int) -> decltype(it.contiguous_bytes(end))
+{
+    return it.contiguous_bytes(end);
+}
+
+template<typename Iterator>
+StringView contiguous_bytes(const Iterator&, const Iterator&, long) { return {}; }
+
+template<typename Iterator>
+auto contiguous_bytes_before(const Iterator& it, const Iterator& begin, int) -> decltype(it.contiguous_bytes_before(begin))
+{
+    return it.contiguous_bytes_before(begin);
+}
+
+template<typename Iterator>
+StringView contiguous_bytes_before(const Iterator&, const Iterator&, long) { return {}; }
+}
+
+// Returns the bytes from it, up to end, that can be read directly. Iterators
+// over segmented text, such as buffer lines, give their current segment
+// with a contiguous_bytes method, so that scans run over raw memory and
+// only go through the iterator at segment edges. Others give none.
+template<typename Iterator>
+StringView contiguous_bytes(const Iterator& it, const Iterator& end)
+{
+    return detail::contiguous_bytes(it, end, 0);
+}
+
+inline StringView contiguous_bytes(const char* it, const char* end) { return {it, end}; }
+
+// Same as above for the bytes before it, down to begin
+template<typename Iterator>
+StringView contiguous_bytes_before(const Iterator& it, const Iterator& begin)
+{
+    return detail::contiguous_bytes_before(it, begin, 0);
+}
+
+inline StringView contiguous_bytes_before(const char* it, const char* begin) { return {begin, it}; }
+
+// moves it to the first occurrence of c before last, or to last, calling
+// poll with the count of bytes scanned
+template<typename Iterator, typename Poll>
+void to_next_byte(Iterator& it, const Iterator& last, char c, Poll& poll)
+{
+    while (it != last)
+    {
+        const StringView bytes = contiguous_bytes(it, last);
+        if (bytes.empty())
+        {
+            if (*it == c)
+                return;
+            ++it;
+            poll(1);
+        }
+        else if (auto* found = static_cast<const char*>(memchr(bytes.begin(), c, (int)bytes.length())))
+        {
+            it += (int)(found - bytes.begin());
+            return;
+        }
+        else
+        {
+            it += (int)bytes.length();
+            poll((int)bytes.length());
+        }
+    }
+}
+
+// moves it back to the last occurrence of c after first, returning false
+// with it at first if there is none, calling poll with the count of bytes
+// scanned
+template<typename Iterator, typename Poll>
+bool to_prev_byte(Iterator& it, const Iterator& first, char c, Poll& poll)
+{
+    while (it != first)
+    {
+        const StringView bytes = contiguous_bytes_before(it, first);
+        if (bytes.empty())
+        {
+            if (*--it == c)
+                return true;
+            poll(1);
+            continue;
+        }
+        const char* pos = bytes.end();
+        while (pos != bytes.begin() and *(pos-1) != c)
+            --pos;
+        it -= (int)(bytes.end() - pos);
+        poll((int)(bytes.end() - pos));
+        if (pos != bytes.begin())
+        {
+            --it;
+            return true;
+        }
+    }
+    return false;
+}
+
+// returns the start of the first occurrence of literal in [begin, end)
+// starting at or before last_start, or end, calling poll with the count of
+// bytes scanned
+template<typename Iterator, typename Poll>
+Iterator find_literal(Iterator begin, const Iterator& end, StringView literal,
+                      const Iterator& last_start, Poll&& poll)
+{
+    kak_assert(not literal.empty());
+    if (last_start < begin)
+        return end;
+    while (true)
+    {
+        to_next_byte(begin, last_start, literal[0], poll);
+        if (begin == end)
+            return end;
+
+        if (*begin == literal[0])
+        {
+            auto it = begin;
+            auto lit = literal.begin();
+            while (++lit != literal.end() and ++it != end and *it == *lit)
+            {}
+            if (lit == literal.end())
+                return begin;
+            if (it == end) // not enough data left for an occurrence
+                return end;
+        }
+        if (begin == last_start)
+            return end;
+        ++begin;
+    }
+}
+
+// contiguous subjects are scanned by memmem, fast enough not to poll
+template<typename Poll>
+const char* find_literal(const char* begin, const char* end, StringView literal,
+                         const char* last_start, Poll&&)
+{
+    if (last_start < begin)
+        return end;
+    const size_t size = std::min<size_t>(end - begin, last_start - begin + (int)literal.length());
+    auto* res = memmem(begin, size, literal.begin(), (int)literal.length());
+    return res ? static_cast<const char*>(res) : end;
+}
+
+template<typename Iterator>
+Iterator find_literal(const Iterator& begin, const Iterator& end, StringView literal)
+{
+    return find_literal(begin, end, literal, end, [](int) {});
+}
+
+// matches literal, which must be lowercase ascii if ignore_case, from it,
+// moving it past the match
+template<bool ignore_case, typename Iterator>
+bool match_literal(Iterator& it, const Iterator& end, StringView literal)
+{
+    for (char c : literal)
+    {
+        if (it == end)
+            return false;
+        if (not ignore_case or (unsigned char)*it < 0x80)
+        {
+            if ((ignore_case ? to_lower(*it) : *it) != c)
+                return false;
+            ++it;
+        }
+        else if (to_lower(utf8::read_codepoint(it, end)) != (Codepoint)c)
+            return false;
+    }
+    return true;
+}
+
+// Runs a compiled program, which it does not modify: the execution state
+// lives in the VM, so that VMs on different threads can run the same
+// program concurrently.
 template<typename Iterator, MatchDirection direction>
-class ThreadedRegexVM
+class ThreadedRegexVM : public RegexVMBase
 {
 public:
     ThreadedRegexVM(const CompiledRegex& program)
-      : m_program{program}
+      : m_program{program}, m_instruction_states(program.instructions.size())
     {
         kak_assert(m_program and direction == m_program.direction);
+        ++regex_vm_stats.vms_built;
     }
 
     ThreadedRegexVM(const ThreadedRegexVM&) = delete;
@@ -125,20 +562,39 @@ public:
 
     ~ThreadedRegexVM()
     {
+        if (m_dfa)
+            m_program.give_back_dfa(std::move(m_dfa));
         for (auto* saves : m_saves)
         {
             for (size_t i = m_program.save_count-1; i > 0; --i)
                 saves->pos[i].~Iterator();
             saves->~Saves();
-            operator delete(saves);
+            ::operator delete(saves);
         }
     }
 
     bool exec(Iterator begin, Iterator end, RegexExecFlags flags)
+    {
+        return exec(begin, end, end, flags);
+    }
+
+    // Only looks for matches starting at or before last_start, which can
+    // still extend up to end, so that the parts of a subject can be searched
+    // separately. Bounded searches must be forward ones.
+    bool exec(Iterator begin, Iterator last_start, Iterator end, RegexExecFlags flags)
     {
         if (flags & RegexExecFlags::NotInitialNull and begin == end)
             return false;
 
+        m_bounded = last_start != end;
+        kak_assert(not m_bounded or (direction == MatchDirection::Forward and
+                                     (flags & RegexExecFlags::Search) and
+                                     not (last_start < begin)));
+
+        if (m_program.literal_pattern)
+            return m_program.literal_pattern->ignore_case ?
+                exec_literal<true>(begin, last_start, end, flags) : exec_literal<false>(begin, last_start, end, flags);
+
         constexpr bool forward = direction == MatchDirection::Forward;
         const bool prev_avail = flags & RegexExecFlags::PrevAvailable;
 
@@ -155,8 +611,36 @@ public:
 
         const bool search = (flags & RegexExecFlags::Search);
         Utf8It start{m_begin};
+        m_last_start = last_start;
+        m_use_literal = false;
+        if (search and forward and m_program.required_literal)
+        {
+            m_subject_begin = begin;
+            m_subject_end = end;
+            // the literal can only be bounded as well when it starts the matches
+            m_literal_last_start = m_program.required_literal->offset == 0 ? last_start : end;
+            m_literal_pos = find_literal(begin, end, m_program.required_literal->value, m_literal_last_start,
+                                         [this](int count){ poll_interrupt(count); });
+            if (m_literal_pos == end)
+                return false;
+            m_use_literal = true;
+        }
+        // The DFA answers existence queries, and rejects subjects before the
+        // VM extracts the captures of a full match
+        const bool no_captures = (flags & RegexExecFlags::AnyMatch) and (flags & RegexExecFlags::NoSaves);
+        if ((no_captures or not search) and not m_bounded)
+        {
+            bool matched = false;
+            if (exec_dfa(start, search, matched) and (no_captures or not matched))
+                return matched;
+        }
+
         if (search)
+        {
             to_next_start(start, m_end, m_program.start_chars.get());
+            if (past_last_start(start))
+                return false;
+        }
 
         return exec_program(start, Thread{&m_program.instructions[search ? 0 : CompiledRegex::search_prefix_size], nullptr});
     }
@@ -168,6 +652,25 @@ public:
         return {};
     }
 
+    // Drops the captures and iterators of the last execution, so that an
+    // idle VM does not refer to its subject anymore
+    void forget_subject()
+    {
+        release_threads();
+        release_saves(m_captures);
+        m_captures = nullptr;
+        if (std::is_trivially_destructible<Iterator>::value)
+            return;
+        for (auto* saves : m_saves)
+            std::fill(saves->pos, saves->pos + m_program.save_count, Iterator{});
+        m_begin = m_end = Utf8It{};
+        m_last_start = m_subject_begin = m_subject_end = Iterator{};
+        m_literal_pos = m_literal_last_start = Iterator{};
+    }
+
+    // the DFA taken from the program, if it was used
+    const RegexDFA* dfa() const { return m_dfa.get(); }
+
 private:
     struct Saves
     {
@@ -197,7 +700,8 @@ private:
             return res;
         }
 
-        void* ptr = operator new (sizeof(Saves) + (count-1) * sizeof(Iterator));
+        ++regex_vm_stats.saves_allocated;
+        void* ptr = ::operator new (sizeof(Saves) + (count-1) * sizeof(Iterator));
         Saves* saves = new (ptr) Saves{{1}, {copy ? pos[0] : Iterator{}}};
         for (size_t i = 1; i < count; ++i)
             new (&saves->pos[i]) Iterator{copy ? pos[i] : Iterator{}};
@@ -224,11 +728,18 @@ private:
                                       utf8::iterator<Iterator>,
                                       std::reverse_iterator<utf8::iterator<Iterator>>>;
 
+    struct InstructionState
+    {
+        // last step a thread reached the instruction
+        uint16_t last_step = 0;
+        // a thread at this instruction is scheduled for the next codepoint
+        bool scheduled = false;
+    };
+
     struct ExecState
     {
         Vector<Thread, MemoryDomain::Regex> current_threads;
         Vector<Thread, MemoryDomain::Regex> next_threads;
-        uint16_t step = -1;
     };
 
     enum class StepResult { Consumed, Matched, Failed, FindNextStart };
@@ -241,9 +752,10 @@ private:
         while (true)
         {
             auto& inst = *thread.inst++;
-            if (inst.last_step == state.step)
+            auto& last_step = m_instruction_states[&inst - instructions].last_step;
+            if (last_step == m_step)
                 return StepResult::Failed;
-            inst.last_step = state.step;
+            last_step = m_step;
 
             switch (inst.op)
             {
@@ -257,6 +769,16 @@ private:
                     return StepResult::Failed;
                 case CompiledRegex::AnyChar:
                     return StepResult::Consumed;
+                case CompiledRegex::LiteralSwitch:
+                {
+                    if (pos == m_end)
+                        return StepResult::Failed;
+                    auto* target = m_program.literal_switches[inst.param].target(*pos);
+                    if (not target)
+                        return StepResult::Failed;
+                    thread.inst = instructions + *target;
+                    return StepResult::Consumed;
+                }
                 case CompiledRegex::Jump:
                     thread.inst = instructions + inst.param;
                     break;
@@ -292,7 +814,7 @@ private:
                 case CompiledRegex::Matcher:
                     if (pos == m_end)
                         return StepResult::Failed;
-                    return m_program.matchers[inst.param](*pos) ?
+                    return m_program.character_classes[inst.param].matches(*pos) ?
                         StepResult::Consumed : StepResult::Failed;
                 case CompiledRegex::LineStart:
                     if (not is_line_start(pos))
@@ -344,6 +866,8 @@ private:
                     break;
                 case CompiledRegex::FindNextStart:
                     kak_assert(state.current_threads.empty()); // search thread should by construction be the lower priority one
+                    if (m_bounded and not (get_base(pos) < m_last_start))
+                        return StepResult::Failed;
                     if (state.next_threads.empty())
                         return StepResult::FindNextStart;
                     return StepResult::Consumed;
@@ -354,20 +878,202 @@ private:
         return StepResult::Failed;
     }
 
+    template<bool ignore_case>
+    bool exec_literal(const Iterator& begin, const Iterator& last_start, const Iterator& end, RegexExecFlags flags)
+    {
+        const auto& pattern = *m_program.literal_pattern;
+        auto matches_at = [&](const Iterator& pos, Iterator& match_end) {
+            match_end = pos;
+            return (ignore_case ? utf8::is_character_start(*pos) : *pos == pattern.value[0_byte]) and
+                   match_literal<ignore_case>(match_end, end, pattern.value) and
+                   (not pattern.word_start or is_word_boundary(pos, begin, end, flags)) and
+                   (not pattern.word_end or is_word_boundary(match_end, begin, end, flags));
+        };
+
+        Iterator match_begin = begin, match_end;
+        if (not (flags & RegexExecFlags::Search))
+        {
+            if (begin == end or not matches_at(begin, match_end) or match_end != end)
+                return false;
+        }
+        else if (direction == MatchDirection::Forward)
+        {
+            const char first = pattern.value[0_byte];
+            for (;; ++match_begin)
+            {
+                if (not ignore_case)
+                    match_begin = find_literal(match_begin, end, pattern.value, last_start,
+                                               [this](int count){ poll_interrupt(count); });
+                else // skip ascii characters that cannot start a match
+                {
+                    while (match_begin != last_start and (unsigned char)*match_begin < 0x80 and
+                           to_lower(*match_begin) != first)
+                    {
+                        ++match_begin;
+                        poll_interrupt();
+                    }
+                }
+                if (match_begin == end)
+                    return false;
+                if (matches_at(match_begin, match_end))
+                    break;
+                if (match_begin == last_start)
+                    return false;
+            }
+        }
+        else // the last match is the one starting last, as they all have the same length
+        {
+            auto poll = [this](int count){ poll_interrupt(count); };
+            for (match_begin = end; ; )
+            {
+                if (not ignore_case)
+                {
+                    if (not to_prev_byte(match_begin, begin, pattern.value[0_byte], poll))
+                        return false;
+                }
+                else if (match_begin != begin)
+                {
+                    --match_begin;
+                    poll_interrupt();
+                }
+                else
+                    return false;
+                if (matches_at(match_begin, match_end))
+                    break;
+            }
+        }
+
+        if (not (flags & RegexExecFlags::NoSaves))
+        {
+            release_saves(m_captures);
+            m_captures = new_saves<false>(nullptr);
+            m_captures->pos[0] = match_begin;
+            m_captures->pos[1] = match_end;
+        }
+        return true;
+    }
+
+    // Runs the DFA from pos, returning false if it is not usable or gave up
+    bool exec_dfa(Utf8It pos, bool search, bool& matched)
+    {
+        if (not m_dfa)
+            m_dfa = m_program.take_dfa();
+        auto& dfa = *m_dfa;
+        if (not dfa.enabled())
+            return false;
+
+        const bool not_initial_null = m_flags & RegexExecFlags::NotInitialNull;
+        auto state = dfa.start_state(search, dfa_context(pos));
+        while (state >= 0)
+        {
+            if (search and pos != m_end and dfa.is_idle(state))
+            {
+                const auto prev = pos;
+                to_next_start(pos, m_end, m_program.start_chars.get());
+                if (pos != prev and (state = dfa.start_state(true, dfa_context(pos))) < 0)
+                    break;
+            }
+            if (pos == m_end)
+            {
+                matched = dfa.matches_at_end(m_program, state) and
+                          not (not_initial_null and pos == m_begin);
+                return true;
+            }
+
+            bool bytes_matched = false;
+            if (not (not_initial_null and pos == m_begin) and
+                step_dfa_on_bytes(dfa, state, pos, search, bytes_matched))
+            {
+                if (bytes_matched)
+                    return matched = true;
+                continue;
+            }
+
+            auto transition = dfa.step(m_program, state, *pos);
+            if (search and transition.matched and not (not_initial_null and pos == m_begin))
+            {
+                matched = true;
+                return true;
+            }
+            state = transition.next;
+            ++pos;
+            poll_interrupt();
+        }
+        matched = false;
+        return state == RegexDFA::failed;
+    }
+
+    // Steps the DFA through the ascii bytes from pos that can be read
+    // directly, until it fails, matches or idles. Returns false if there
+    // were none to step through.
+    bool step_dfa_on_bytes(RegexDFA& dfa, RegexDFA::StateIndex& state,
+                           utf8::iterator<Iterator>& pos, bool search, bool& matched)
+    {
+        const StringView bytes = contiguous_bytes(pos.base(), m_end.base()).substr(0_byte, poll_interval);
+        const char* it = bytes.begin();
+        while (it != bytes.end() and (unsigned char)*it < 0x80)
+        {
+            auto transition = dfa.step(m_program, state, *it);
+            if (search and transition.matched)
+            {
+                matched = true;
+                return true;
+            }
+            ++it;
+            state = transition.next;
+            if (state < 0 or (search and dfa.is_idle(state)))
+                break;
+        }
+        if (it == bytes.begin())
+            return false;
+        pos.skip_bytes((int)(it - bytes.begin()));
+        poll_interrupt((int)(it - bytes.begin()));
+        return true;
+    }
+
+    // Reverse executions step codepoint by codepoint
+    bool step_dfa_on_bytes(RegexDFA&, RegexDFA::StateIndex&,
+                           std::reverse_iterator<utf8::iterator<Iterator>>&, bool, bool&)
+    {
+        return false;
+    }
+
+    int dfa_context(const Utf8It& pos) const
+    {
+        int context = ((m_flags & RegexExecFlags::NotEndOfLine) ? RegexDFA::NotEndOfLine : 0) |
+                      ((m_flags & RegexExecFlags::NotEndOfWord) ? RegexDFA::NotEndOfWord : 0);
+        if (is_line_start(pos))
+            context |= RegexDFA::LineStart;
+        if (pos == m_begin and not (m_flags & RegexExecFlags::NotBeginOfSubject))
+            context |= RegexDFA::SubjectBegin;
+        if (not (m_flags & RegexExecFlags::PrevAvailable) and pos == m_begin)
+            context |= RegexDFA::FixedWordBoundary |
+                       ((m_flags & RegexExecFlags::NotBeginOfWord) ? 0 : RegexDFA::PrevWord);
+        else if (is_word(*(pos-1)))
+            context |= RegexDFA::PrevWord;
+        return context;
+    }
+
+    InstructionState& instruction_state(const CompiledRegex::Instruction* inst)
+    {
+        return m_instruction_states[inst - m_program.instructions.data()];
+    }
+
     bool exec_program(Utf8It pos, Thread init_thread)
     {
-        ExecState state;
+        release_threads();
+        auto& state = m_state;
         state.current_threads.push_back(init_thread);
 
         bool found_match = false;
         while (true) // Iterate on all codepoints and once at the end
         {
-            if (++state.step == 0)
+            if (++m_step == 0)
             {
-                // We wrapped, avoid potential collision on inst.last_step by resetting them
-                for (auto& inst : m_program.instructions)
-                    inst.last_step = 0;
-                state.step = 1; // step 0 is never valid
+                // We wrapped, avoid potential collision on last_step by resetting them
+                for (auto& inst_state : m_instruction_states)
+                    inst_state.last_step = 0;
+                m_step = 1; // step 0 is never valid
             }
 
             bool find_next_start = false;
@@ -398,12 +1104,12 @@ private:
                     release_saves(thread.saves);
                     break;
                 case StepResult::Consumed:
-                    if (thread.inst->scheduled)
+                    if (instruction_state(thread.inst).scheduled)
                     {
                         release_saves(thread.saves);
                         continue;
                     }
-                    thread.inst->scheduled = true;
+                    instruction_state(thread.inst).scheduled = true;
                     state.next_threads.push_back(thread);
                     break;
                 case StepResult::FindNextStart:
@@ -413,36 +1119,165 @@ private:
                 }
             }
             for (auto& thread : state.next_threads)
-                thread.inst->scheduled = false;
+                instruction_state(thread.inst).scheduled = false;
 
             if (pos == m_end or state.next_threads.empty() or
                 (found_match and (m_flags & RegexExecFlags::AnyMatch)))
             {
-                for (auto& t : state.next_threads)
-                    release_saves(t.saves);
+                release_threads();
                 return found_match;
             }
 
             std::swap(state.current_threads, state.next_threads);
             std::reverse(state.current_threads.begin(), state.current_threads.end());
             ++pos;
+            poll_interrupt();
 
             if (find_next_start)
+            {
                 to_next_start(pos, m_end, m_program.start_chars.get());
+                if (past_last_start(pos))
+                {
+                    release_threads();
+                    return false;
+                }
+            }
+        }
+    }
+
+    // Releases the threads left by the last execution, which can have been
+    // interrupted while they were running
+    void release_threads()
+    {
+        for (auto& t : m_state.current_threads)
+            release_saves(t.saves);
+        for (auto& t : m_state.next_threads)
+            release_saves(t.saves);
+        m_state.current_threads.clear();
+        m_state.next_threads.clear();
+    }
+
+    // Polls the interrupt of the thread every few thousand positions, so that
+    // executions can be stopped without slowing them down
+    void poll_interrupt(int count = 1)
+    {
+        if ((m_poll_countdown -= count) <= 0)
+        {
+            m_poll_countdown = poll_interval;
+            RegexInterrupt::poll();
         }
     }
 
+    // Only the search thread moves pos to the next start, the threads
+    // already started still run past m_last_start
+    bool past_last_start(const Utf8It& pos) const
+    {
+        return m_bounded and m_last_start < get_base(pos);
+    }
+
     void to_next_start(Utf8It& start, const Utf8It& end,
                        const CompiledRegex::StartChars* start_chars)
     {
-        if (not start_chars)
-            return;
+        while (true)
+        {
+            // jump to the literal first, it is found much faster than start chars
+            if (m_use_literal)
+                to_next_literal(start);
+            if (not start_chars)
+                return;
+
+            const auto pos = start;
+            while (true)
+            {
+                skip_ascii_non_start(start, end, *start_chars);
+                if (start == end or *start < 0 or
+                    start_chars->map[std::min(*start, CompiledRegex::StartChars::other)])
+                    break;
+                ++start;
+                poll_interrupt();
+            }
+            if (not m_use_literal or start == pos)
+                return;
+        }
+    }
+
+    // Skips the ascii characters that cannot start a match by reading the
+    // contiguous bytes of the subject, stopping on any other codepoint
+    void skip_ascii_non_start(utf8::iterator<Iterator>& start, const utf8::iterator<Iterator>& end,
+                              const CompiledRegex::StartChars& start_chars)
+    {
+        while (start != end)
+        {
+            const StringView bytes = contiguous_bytes(start.base(), end.base()).substr(0_byte, poll_interval);
+            const char* it = bytes.begin();
+            while (it != bytes.end() and (unsigned char)*it < 0x80 and not start_chars.map[(int)*it])
+                ++it;
+            if (it == bytes.begin())
+                return;
+            start.skip_bytes((int)(it - bytes.begin()));
+            poll_interrupt((int)(it - bytes.begin()));
+            if (it != bytes.end())
+                return;
+        }
+    }
+
+    // Same as above for reverse searches, which read the bytes before their
+    // position
+    void skip_ascii_non_start(std::reverse_iterator<utf8::iterator<Iterator>>& start,
+                              const std::reverse_iterator<utf8::iterator<Iterator>>& end,
+                              const CompiledRegex::StartChars& start_chars)
+    {
+        while (start != end)
+        {
+            StringView bytes = contiguous_bytes_before(start.base().base(), end.base().base());
+            bytes = bytes.substr(std::max(0_byte, bytes.length() - poll_interval));
+            const char* it = bytes.end();
+            while (it != bytes.begin() and (unsigned char)*(it-1) < 0x80 and not start_chars.map[(int)*(it-1)])
+                --it;
+            if (it == bytes.end())
+                return;
+            auto base = start.base();
+            start = Utf8It{base.skip_bytes(-(int)(bytes.end() - it))};
+            poll_interrupt((int)(bytes.end() - it));
+            if (it != bytes.begin())
+                return;
+        }
+    }
 
-        while (start != end and *start >= 0 and
-               not start_chars->map[std::min(*start, CompiledRegex::StartChars::other)])
-            ++start;
+    // Moves start to the first position from which the required literal can
+    // be matched, or to the subject end if it does not appear anymore
+    void to_next_literal(utf8::iterator<Iterator>& start)
+    {
+        auto& literal = *m_program.required_literal;
+        while (start != m_end)
+        {
+            const Iterator& pos = start.base();
+            if (m_literal_pos == m_subject_end)
+                start = m_end;
+            else if (m_literal_pos < pos)
+                m_literal_pos = find_literal(pos, m_subject_end, literal.value, m_literal_last_start,
+                                             [this](int count){ poll_interrupt(count); });
+            else if (literal.offset < 0)
+                return;
+            else
+            {
+                utf8::iterator<Iterator> candidate{m_literal_pos, m_subject_begin, m_subject_end};
+                candidate -= literal.offset;
+                if (not (candidate.base() < pos))
+                {
+                    start = candidate;
+                    return;
+                }
+                // too close to start to be part of a match from there
+                m_literal_pos = find_literal(std::next(m_literal_pos), m_subject_end, literal.value,
+                                             m_literal_last_start, [this](int count){ poll_interrupt(count); });
+            }
+        }
     }
 
+    // Literals are only used for forward searches
+    void to_next_literal(std::reverse_iterator<utf8::iterator<Iterator>>&) {}
+
     template<MatchDirection look_direction, bool ignore_case>
     bool lookaround(uint32_t index, Utf8It pos) const
     {
@@ -459,7 +1294,7 @@ private:
             {} // any character matches
             else if (ref > 0xF0000 and ref <= 0xFFFFD)
             {
-                if (not m_program.matchers[ref - 0xF0001](cp))
+                if (not m_program.character_classes[ref - 0xF0001].matches(cp))
                     return false;
             }
             else if (ref != cp)
@@ -493,26 +1328,87 @@ private:
         return is_word(*(pos-1)) != is_word(*pos);
     }
 
+    // Same as above for literal patterns, which are only forward
+    static bool is_word_boundary(const Iterator& pos, const Iterator& begin, const Iterator& end,
+                                 RegexExecFlags flags)
+    {
+        const bool prev_avail = flags & RegexExecFlags::PrevAvailable;
+        if (not prev_avail and pos == begin)
+            return not (flags & RegexExecFlags::NotBeginOfWord);
+        if (pos == end)
+            return not (flags & RegexExecFlags::NotEndOfWord);
+        return is_word(utf8::codepoint(utf8::previous(pos, prev_avail ? begin-1 : begin), end)) !=
+               is_word(utf8::codepoint(pos, end));
+    }
+
     static const Iterator& get_base(const utf8::iterator<Iterator>& it) { return it.base(); }
     static Iterator get_base(const std::reverse_iterator<utf8::iterator<Iterator>>& it) { return it.base().base(); }
 
     const CompiledRegex& m_program;
 
+    Vector<InstructionState, MemoryDomain::Regex> m_instruction_states;
+    uint16_t m_step = 0;
+    std::unique_ptr<RegexDFA> m_dfa;
+
     Utf8It m_begin;
     Utf8It m_end;
     RegexExecFlags m_flags;
+    bool m_bounded = false;
+    Iterator m_last_start;
+
+    bool m_use_literal = false;
+    Iterator m_subject_begin;
+    Iterator m_subject_end;
+    // next occurrence of the required literal, or m_subject_end
+    Iterator m_literal_pos;
+    Iterator m_literal_last_start;
 
     Vector<Saves*, MemoryDomain::Regex> m_saves;
     Saves* m_first_free = nullptr;
 
     Saves* m_captures = nullptr;
+    // kept across executions to reuse their storage
+    ExecState m_state;
+
+    static constexpr int poll_interval = 4096;
+    int m_poll_countdown = poll_interval;
+};
+
+// A VM of the program, taken from its idle ones or built if there are none,
+// and given back to it once done with
+template<typename Iterator, MatchDirection direction>
+class PooledRegexVM
+{
+public:
+    using VM = ThreadedRegexVM<Iterator, direction>;
+
+    explicit PooledRegexVM(const CompiledRegex& program)
+        : m_program{program}, m_vm{static_cast<VM*>(program.take_vm(typeid(VM)).release())}
+    {
+        if (m_vm)
+            ++regex_vm_stats.vms_reused;
+        else
+            m_vm.reset(new VM{program});
+    }
+
+    ~PooledRegexVM()
+    {
+        m_vm->forget_subject();
+        m_program.give_back_vm(std::move(m_vm));
+    }
+
+    VM* operator->() { return m_vm.get(); }
+
+private:
+    const CompiledRegex& m_program;
+    std::unique_ptr<VM> m_vm;
 };
 
 template<typename It, MatchDirection direction = MatchDirection::Forward>
 bool regex_match(It begin, It end, const CompiledRegex& re, RegexExecFlags flags = RegexExecFlags::None)
 {
-    ThreadedRegexVM<It, direction> vm{re};
-    return vm.exec(begin, end, (RegexExecFlags)(flags & ~(RegexExecFlags::Search)) |
+    PooledRegexVM<It, direction> vm{re};
+    return vm->exec(begin, end, (RegexExecFlags)(flags & ~(RegexExecFlags::Search)) |
                                RegexExecFlags::AnyMatch | RegexExecFlags::NoSaves);
 }
 
@@ -520,10 +1416,10 @@ template<typename It, MatchDirection direction = MatchDirection::Forward>
 bool regex_match(It begin, It end, Vector<It, MemoryDomain::Regex>& captures, const CompiledRegex& re,
                  RegexExecFlags flags = RegexExecFlags::None)
 {
-    ThreadedRegexVM<It, direction> vm{re};
-    if (vm.exec(begin, end,  flags & ~(RegexExecFlags::Search)))
+    PooledRegexVM<It, direction> vm{re};
+    if (vm->exec(begin, end,  flags & ~(RegexExecFlags::Search)))
     {
-        std::copy(vm.captures().begin(), vm.captures().end(), std::back_inserter(captures));
+        std::copy(vm->captures().begin(), vm->captures().end(), std::back_inserter(captures));
         return true;
     }
     return false;
@@ -533,18 +1429,18 @@ template<typename It, MatchDirection direction = MatchDirection::Forward>
 bool regex_search(It begin, It end, const CompiledRegex& re,
                   RegexExecFlags flags = RegexExecFlags::None)
 {
-    ThreadedRegexVM<It, direction> vm{re};
-    return vm.exec(begin, end, flags | RegexExecFlags::Search | RegexExecFlags::AnyMatch | RegexExecFlags::NoSaves);
+    PooledRegexVM<It, direction> vm{re};
+    return vm->exec(begin, end, flags | RegexExecFlags::Search | RegexExecFlags::AnyMatch | RegexExecFlags::NoSaves);
 }
 
 template<typename It, MatchDirection direction = MatchDirection::Forward>
 bool regex_search(It begin, It end, Vector<It, MemoryDomain::Regex>& captures, const CompiledRegex& re,
                   RegexExecFlags flags = RegexExecFlags::None)
 {
-    ThreadedRegexVM<It, direction> vm{re};
-    if (vm.exec(begin, end, flags | RegexExecFlags::Search))
+    PooledRegexVM<It, direction> vm{re};
+    if (vm->exec(begin, end, flags | RegexExecFlags::Search))
     {
-        std::move(vm.captures().begin(), vm.captures().end(), std::back_inserter(captures));
+        std::move(vm->captures().begin(), vm->captures().end(), std::back_inserter(captures));
         return true;
     }
     return false;
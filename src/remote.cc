@@ -348,6 +348,8 @@ public:
     void set_on_key(OnKeyCallback callback) override
     { m_on_key = std::move(callback); }
 
+    void read_available_keys() override;
+
     void set_ui_options(const Options& options) override;
 
     void set_client(Client* client) { m_client = client; }
@@ -356,11 +358,15 @@ public:
     void exit(int status);
 
 private:
+    bool read_keys(int sock);
+
     FDWatcher     m_socket_watcher;
     MsgReader     m_reader;
     DisplayCoord  m_dimensions;
     OnKeyCallback m_on_key;
     RemoteBuffer  m_send_buffer;
+    // set when the client went away while it was in use
+    bool          m_disconnected = false;
 
     SafePtr<Client> m_client;
 };
@@ -386,25 +392,8 @@ RemoteUI::RemoteUI(int socket, DisplayCoord dimensions)
               if (events & FdEvents::Write and send_data(sock, m_send_buffer))
                   m_socket_watcher.events() &= ~FdEvents::Write;
 
-              while (events & FdEvents::Read and fd_readable(sock))
-              {
-                  m_reader.read_available(sock);
-
-                  if (not m_reader.ready())
-                      continue;
-
-                   if (m_reader.type() != MessageType::Key)
-                   {
-                      ClientManager::instance().remove_client(*m_client, false, -1);
-                      return;
-                   }
-
-                   auto key = m_reader.read<Key>();
-                   m_reader.reset();
-                   if (key.modifiers == Key::Modifiers::Resize)
-                       m_dimensions = key.coord();
-                   m_on_key(key);
-              }
+              if (m_disconnected or (events & FdEvents::Read and not read_keys(sock)))
+                  ClientManager::instance().remove_client(*m_client, false, -1);
           }
           catch (const disconnected& err)
           {
@@ -417,6 +406,48 @@ RemoteUI::RemoteUI(int socket, DisplayCoord dimensions)
     write_to_debug_buffer(format("remote client connected: {}", m_socket_watcher.fd()));
 }
 
+// returns false when a message other than a key was received
+bool RemoteUI::read_keys(int sock)
+{
+    while (fd_readable(sock))
+    {
+        m_reader.read_available(sock);
+
+        if (not m_reader.ready())
+            continue;
+
+        if (m_reader.type() != MessageType::Key)
+            return false;
+
+        auto key = m_reader.read<Key>();
+        m_reader.reset();
+        if (key.modifiers == Key::Modifiers::Resize)
+            m_dimensions = key.coord();
+        m_on_key(key);
+    }
+    return true;
+}
+
+void RemoteUI::read_available_keys()
+{
+    // The client is in use, removing it is left to the socket watcher
+    if (m_disconnected)
+        return;
+
+    const int sock = m_socket_watcher.fd();
+    try
+    {
+        m_disconnected = not read_keys(sock);
+    }
+    catch (const disconnected& err)
+    {
+        write_to_debug_buffer(format("Error while transfering remote messages: {}", err.what()));
+        m_disconnected = true;
+    }
+    if (m_disconnected)
+        EventManager::instance().force_signal(sock);
+}
+
 RemoteUI::~RemoteUI()
 {
     // Try to send the remaining data if possible, as it might contain the desired exit status
@@ -115,6 +115,9 @@ BufferCoord& get_last(Selection& sel) { return sel.max(); }
 Vector<Selection> compute_modified_ranges(Buffer& buffer, size_t timestamp)
 {
     Vector<Selection> ranges;
+    if (buffer.changes_discarded(timestamp))
+        return { {{0,0}, buffer.back_coord()} };
+
     auto changes = buffer.changes_since(timestamp);
     auto change_it = changes.begin();
     while (change_it != changes.end())
@@ -209,7 +212,9 @@ void update_selections(Vector<Selection>& selections, size_t& main, Buffer& buff
     if (timestamp == buffer.timestamp())
         return;
 
-    auto changes = buffer.changes_since(timestamp);
+    // Changes are not available anymore, only clamp to the current content
+    auto changes = buffer.changes_discarded(timestamp) ? ConstArrayView<Buffer::Change>{}
+                                                       : buffer.changes_since(timestamp);
     auto change_it = changes.begin();
     while (change_it != changes.end())
     {
@@ -431,7 +436,7 @@ void SelectionList::insert(ConstArrayView<String> strings, InsertMode mode,
         }
         else if (not str.empty())
         {
-            auto& change = m_buffer->changes_since(0).back();
+            auto& change = m_buffer->changes_since(old_timestamp).back();
             sel.anchor() = m_buffer->clamp(update_insert(sel.anchor(), change.begin, change.end));
             sel.cursor() = m_buffer->clamp(update_insert(sel.cursor(), change.begin, change.end));
         }
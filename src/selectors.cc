@@ -1,5 +1,6 @@
 #include "selectors.hh"
 
+#include "buffer_snapshot.hh"
 #include "buffer_utils.hh"
 #include "context.hh"
 #include "flags.hh"
@@ -11,6 +12,9 @@
 #include "utf8_iterator.hh"
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
 
 namespace Kakoune
 {
@@ -900,41 +904,334 @@ Selection find_next_match(const Context& context, const Selection& sel, const Re
 template Selection find_next_match<MatchDirection::Forward>(const Context&, const Selection&, const Regex&, bool&);
 template Selection find_next_match<MatchDirection::Backward>(const Context&, const Selection&, const Regex&, bool&);
 
-using RegexIt = RegexIterator<BufferIterator>;
+namespace
+{
+
+// Searching a part of a subject is only equivalent to searching it from a
+// previous match end when matches cannot look behind their start
+bool looks_behind(const CompiledRegex& program)
+{
+    return contains_that(program.instructions, [](const CompiledRegex::Instruction& inst) {
+        return inst.op == CompiledRegex::LookBehind or
+               inst.op == CompiledRegex::NegativeLookBehind or
+               inst.op == CompiledRegex::LookBehind_IgnoreCase or
+               inst.op == CompiledRegex::NegativeLookBehind_IgnoreCase;
+    });
+}
+
+int resolve_thread_count(int thread_count)
+{
+    return thread_count > 0 ? thread_count
+                            : (int)clamp(std::thread::hardware_concurrency(), 1u, 16u);
+}
+
+// A selection searched for regex matches
+struct RegexSubject
+{
+    BufferCoord begin;
+    BufferCoord end;
+    RegexExecFlags flags;
+};
+
+// Part of a subject, searched for the matches starting between begin and
+// last_start, large selections being split in line aligned ranges
+struct SearchRange
+{
+    size_t subject;
+    BufferCoord begin;
+    BufferCoord last_start;
+};
+
+// Ranges are searched by tasks of consecutive ranges of similar sizes,
+// which the worker threads take one at a time
+struct SearchPlan
+{
+    Vector<SearchRange> ranges;
+    Vector<size_t> task_ends;
+    int thread_count;
+};
+
+constexpr ByteCount default_min_task_size = 256 * 1024;
+constexpr int tasks_per_thread = 4;
+
+SearchPlan plan_search(const BufferSnapshot& snapshot, ConstArrayView<RegexSubject> subjects,
+                       bool split_subjects, int thread_count, ByteCount min_task_size)
+{
+    SearchPlan plan;
+    if (thread_count == 1)
+    {
+        for (size_t i = 0; i < subjects.size(); ++i)
+            plan.ranges.push_back({i, subjects[i].begin, subjects[i].end});
+        plan.task_ends.push_back(plan.ranges.size());
+        plan.thread_count = 1;
+        return plan;
+    }
+
+    // selections usually span a few lines, which are quicker to measure
+    // directly than with byte offsets
+    auto size = [&](BufferCoord begin, BufferCoord end) {
+        if (end.line - begin.line > 1)
+            return snapshot.distance(begin, end);
+        return end.column - begin.column +
+               (begin.line != end.line ? snapshot[begin.line].length() : 0);
+    };
+
+    ByteCount total = 0;
+    for (auto& subject : subjects)
+        total += size(subject.begin, subject.end);
+    const ByteCount task_size = std::max(min_task_size, total / (thread_count * tasks_per_thread));
+
+    ByteCount task_bytes = 0;
+    auto end_task = [&] {
+        if (plan.ranges.size() != (plan.task_ends.empty() ? 0 : plan.task_ends.back()))
+            plan.task_ends.push_back(plan.ranges.size());
+        task_bytes = 0;
+    };
+    for (size_t i = 0; i < subjects.size(); ++i)
+    {
+        auto& subject = subjects[i];
+        auto begin = subject.begin;
+        while (split_subjects and snapshot.distance(begin, subject.end) > task_size)
+        {
+            const BufferCoord next{snapshot.advance(begin, task_size).line + 1, 0};
+            if (not (next < subject.end))
+                break;
+            end_task();
+            plan.ranges.push_back({i, begin, snapshot.advance(next, -1)});
+            end_task();
+            begin = next;
+        }
+        plan.ranges.push_back({i, begin, subject.end});
+        if ((task_bytes += size(begin, subject.end)) >= task_size)
+            end_task();
+    }
+    end_task();
+    plan.thread_count = std::min(thread_count, (int)plan.task_ends.size());
+    return plan;
+}
+
+// Calls func(snapshot, next_task) on thread_count threads, each reading its
+// own copy of snapshot, as snapshots are not shareable between threads, and
+// taking its tasks by incrementing next_task up to task_count. The calling
+// thread is one of them, and does all the work if no thread can be started.
+//
+// Workers are interrupted along with the calling thread regex searches, the
+// calling thread keeps checking its interrupt until they are done. The
+// first error stops the remaining tasks, and is rethrown once all are done.
+template<typename Func>
+void run_workers(const BufferSnapshot& snapshot, int thread_count, size_t task_count, Func func)
+{
+    std::atomic<size_t> next_task{0};
+    std::exception_ptr error;
+    std::atomic_flag error_set = ATOMIC_FLAG_INIT;
+    auto on_error = [&] {
+        next_task = task_count;
+        if (not error_set.test_and_set())
+            error = std::current_exception();
+    };
+    auto work = [&](const BufferSnapshot& snapshot) {
+        try
+        {
+            func(snapshot, next_task);
+        }
+        catch (...)
+        {
+            on_error();
+        }
+    };
+
+    const RegexInterrupt* interrupt = RegexInterrupt::current();
+    Vector<BufferSnapshot> snapshots(thread_count - 1, snapshot);
+    Vector<WorkerAllocations> allocations(thread_count - 1);
+    Vector<std::thread> threads;
+    std::atomic<size_t> done_workers{0};
+    for (int i = 0; i < thread_count - 1; ++i)
+    {
+        try
+        {
+            threads.emplace_back([&, i] {
+                allocations[i].count_on_this_thread();
+                RegexInterrupt worker_interrupt{interrupt};
+                work(snapshots[i]);
+                ++done_workers;
+            });
+        }
+        catch (std::system_error&)
+        {
+            break;
+        }
+    }
+    work(snapshot);
+    // workers only follow the interrupt, which needs to be checked here
+    while (interrupt and not interrupt->interrupted() and done_workers != threads.size())
+    {
+        try
+        {
+            RegexInterrupt::poll();
+        }
+        catch (...)
+        {
+            on_error();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    for (auto& thread : threads)
+        thread.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+using SnapshotRegexVM = ThreadedRegexVM<BufferSnapshot::Iterator, MatchDirection::Forward>;
+
+struct RegexMatch
+{
+    BufferCoord begin;
+    BufferCoord end;
+    // the requested capture can be unmatched
+    bool captured;
+    BufferCoord capture_begin;
+    BufferCoord capture_end;
+    CaptureList captures;
+};
+
+// Finds the matches starting between begin and last_start, as a
+// RegexIterator going through the whole subject would, calling on_match
+// on each until it returns false
+template<typename OnMatch>
+void search_matches(SnapshotRegexVM& vm, const BufferSnapshot& snapshot,
+                    const RegexSubject& subject, BufferCoord begin, BufferCoord last_start,
+                    int capture, bool with_captures, OnMatch on_match)
+{
+    using Iterator = BufferSnapshot::Iterator;
+    const auto subject_begin = snapshot.iterator_at(subject.begin);
+    const auto subject_end = snapshot.iterator_at(subject.end);
+    const auto last = snapshot.iterator_at(last_start);
+    bool empty_match = false;
+    for (auto pos = snapshot.iterator_at(begin); not (last < pos); )
+    {
+        auto flags = subject.flags | RegexExecFlags::Search;
+        if (empty_match)
+            flags |= RegexExecFlags::NotInitialNull;
+        if (pos != subject_begin)
+            flags |= RegexExecFlags::NotBeginOfSubject | RegexExecFlags::PrevAvailable;
+        if (not vm.exec(pos, last, subject_end, flags))
+            return;
+
+        const auto captures = vm.captures();
+        const auto& first = captures[capture * 2];
+        RegexMatch match{captures[0].coord(), captures[1].coord(), first != Iterator{},
+                         first.coord(), captures[capture * 2 + 1].coord(), {}};
+        if (with_captures)
+        {
+            match.captures.reserve(captures.size() / 2);
+            for (size_t i = 0; i < captures.size(); i += 2)
+                match.captures.push_back(snapshot.string(captures[i].coord(),
+                                                         captures[i+1].coord()));
+        }
+        empty_match = captures[0] == captures[1];
+        pos = captures[1];
+        if (not on_match(std::move(match)))
+            return;
+    }
+}
+
+// Returns the matches of each selection, searching them on thread_count
+// threads. The matches of each range following a range which last match
+// overlaps it are searched again from that match end, up to one that was
+// already found, so that they are the same as a sequential search's.
+Vector<Vector<RegexMatch>>
+find_matches(const SelectionList& selections, const Regex& regex, int capture,
+             bool with_captures, int thread_count,
+             ByteCount min_task_size = default_min_task_size)
+{
+    const Buffer& buffer = selections.buffer();
+    const auto snapshot = buffer.snapshot();
+    Vector<RegexSubject> subjects;
+    subjects.reserve(selections.size());
+    for (auto& sel : selections)
+    {
+        auto begin = buffer.iterator_at(sel.min());
+        auto end = utf8::next(buffer.iterator_at(sel.max()), buffer.end());
+        subjects.push_back({begin.coord(), end.coord(), match_flags(buffer, begin, end)});
+    }
+
+    const CompiledRegex& program = *regex.impl();
+    const auto plan = plan_search(snapshot, subjects, not looks_behind(program),
+                                  resolve_thread_count(thread_count), min_task_size);
+    Vector<Vector<RegexMatch>> range_matches(plan.ranges.size());
+    run_workers(snapshot, plan.thread_count, plan.task_ends.size(),
+                [&](const BufferSnapshot& snapshot, std::atomic<size_t>& next_task) {
+        SnapshotRegexVM vm{program};
+        for (size_t task; (task = next_task++) < plan.task_ends.size();)
+        {
+            for (size_t i = task == 0 ? 0 : plan.task_ends[task-1]; i < plan.task_ends[task]; ++i)
+            {
+                auto& range = plan.ranges[i];
+                search_matches(vm, snapshot, subjects[range.subject], range.begin, range.last_start,
+                               capture, with_captures, [&](RegexMatch&& match) {
+                    range_matches[i].push_back(std::move(match));
+                    return true;
+                });
+            }
+        }
+    });
+
+    Vector<Vector<RegexMatch>> matches(selections.size());
+    Optional<SnapshotRegexVM> vm;
+    for (size_t i = 0; i < plan.ranges.size(); ++i)
+    {
+        auto& range = plan.ranges[i];
+        auto& subject_matches = matches[range.subject];
+        auto& found = range_matches[i];
+        auto it = found.begin();
+        if (not subject_matches.empty() and range.begin < subject_matches.back().end)
+        {
+            if (not vm)
+                vm.emplace(program);
+            bool synced = false;
+            search_matches(*vm, snapshot, subjects[range.subject], subject_matches.back().end,
+                           range.last_start, capture, with_captures, [&](RegexMatch&& match) {
+                while (it != found.end() and it->begin < match.begin)
+                    ++it;
+                if (it != found.end() and it->begin == match.begin and it->end == match.end)
+                    return not (synced = true);
+                subject_matches.push_back(std::move(match));
+                return true;
+            });
+            if (not synced)
+                it = found.end();
+        }
+        std::move(it, found.end(), std::back_inserter(subject_matches));
+    }
+    return matches;
+}
+
+}
 
-void select_all_matches(SelectionList& selections, const Regex& regex, int capture)
+void select_all_matches(SelectionList& selections, const Regex& regex, int capture, int thread_count)
 {
     const int mark_count = (int)regex.mark_count();
     if (capture < 0 or capture > mark_count)
         throw runtime_error("invalid capture number");
 
+    auto matches = find_matches(selections, regex, capture, true, thread_count);
     Vector<Selection> result;
     auto& buffer = selections.buffer();
-    for (auto& sel : selections)
+    for (size_t i = 0; i < selections.size(); ++i)
     {
-        auto sel_beg = buffer.iterator_at(sel.min());
+        auto& sel = selections[i];
         auto sel_end = utf8::next(buffer.iterator_at(sel.max()), buffer.end());
-        RegexIt re_it(sel_beg, sel_end, regex,
-                      match_flags(buffer, sel_beg, sel_end));
-        RegexIt re_end;
-
-        for (; re_it != re_end; ++re_it)
+        for (auto& match : matches[i])
         {
-            auto begin = (*re_it)[capture].first;
-            if (begin == sel_end)
+            if (not match.captured or match.capture_begin == sel_end.coord())
                 continue;
-            auto end = (*re_it)[capture].second;
-
-            CaptureList captures;
-            captures.reserve(mark_count);
-            for (const auto& match : *re_it)
-                captures.push_back(buffer.string(match.first.coord(),
-                                                 match.second.coord()));
+            auto begin = buffer.iterator_at(match.capture_begin);
+            auto end = buffer.iterator_at(match.capture_end);
 
             result.push_back(
                 keep_direction({ begin.coord(),
                                  (begin == end ? end : utf8::previous(end, begin)).coord(),
-                                 std::move(captures) }, sel));
+                                 std::move(match.captures) }, sel));
         }
     }
     if (result.empty())
@@ -945,27 +1242,25 @@ void select_all_matches(SelectionList& selections, const Regex& regex, int captu
     selections = SelectionList{buffer, std::move(result)};
 }
 
-void split_selections(SelectionList& selections, const Regex& regex, int capture)
+void split_selections(SelectionList& selections, const Regex& regex, int capture, int thread_count)
 {
     if (capture < 0 or capture > (int)regex.mark_count())
         throw runtime_error("invalid capture number");
 
+    const auto matches = find_matches(selections, regex, capture, false, thread_count);
     Vector<Selection> result;
     auto& buffer = selections.buffer();
     auto buf_end = buffer.end();
     auto buf_begin = buffer.begin();
-    for (auto& sel : selections)
+    for (size_t i = 0; i < selections.size(); ++i)
     {
+        auto& sel = selections[i];
         auto begin = buffer.iterator_at(sel.min());
-        auto sel_end = utf8::next(buffer.iterator_at(sel.max()), buffer.end());
-
-        RegexIt re_it(begin, sel_end, regex,
-                      match_flags(buffer, begin, sel_end));
-        RegexIt re_end;
-
-        for (; re_it != re_end; ++re_it)
+        for (auto& match : matches[i])
         {
-            BufferIterator end = (*re_it)[capture].first;
+            if (not match.captured)
+                continue;
+            BufferIterator end = buffer.iterator_at(match.capture_begin);
             if (end == buf_end)
                 continue;
 
@@ -974,7 +1269,7 @@ void split_selections(SelectionList& selections, const Regex& regex, int capture
                 auto sel_end = (begin == end) ? end : utf8::previous(end, begin);
                 result.push_back(keep_direction({ begin.coord(), sel_end.coord() }, sel));
             }
-            begin = (*re_it)[capture].second;
+            begin = buffer.iterator_at(match.capture_end);
         }
         if (begin.coord() <= sel.max())
             result.push_back(keep_direction({ begin.coord(), sel.max() }, sel));
@@ -985,6 +1280,53 @@ void split_selections(SelectionList& selections, const Regex& regex, int capture
     selections = std::move(result);
 }
 
+Vector<Selection> keep_matching(const SelectionList& selections, const Regex& regex,
+                                bool matching, int thread_count)
+{
+    const Buffer& buffer = selections.buffer();
+    const auto snapshot = buffer.snapshot();
+    Vector<RegexSubject> subjects;
+    subjects.reserve(selections.size());
+    for (auto& sel : selections)
+    {
+        auto begin = buffer.iterator_at(sel.min());
+        auto end = utf8::next(buffer.iterator_at(sel.max()), buffer.end());
+        // We do not consider if end is on an eol, as it seems to
+        // give more intuitive behaviours in keep use cases.
+        subjects.push_back({begin.coord(), end.coord(),
+                            match_flags(is_bol(begin.coord()), false,
+                                        is_bow(buffer, begin.coord()),
+                                        is_eow(buffer, end.coord()))});
+    }
+
+    // Selections are not split, as a match anywhere is enough to keep them
+    const auto plan = plan_search(snapshot, subjects, false, resolve_thread_count(thread_count),
+                                  default_min_task_size);
+    Vector<unsigned char> matched(subjects.size(), false);
+    run_workers(snapshot, plan.thread_count, plan.task_ends.size(),
+                [&](const BufferSnapshot& snapshot, std::atomic<size_t>& next_task) {
+        SnapshotRegexVM vm{*regex.impl()};
+        for (size_t task; (task = next_task++) < plan.task_ends.size();)
+        {
+            for (size_t i = task == 0 ? 0 : plan.task_ends[task-1]; i < plan.task_ends[task]; ++i)
+            {
+                auto& subject = subjects[plan.ranges[i].subject];
+                matched[plan.ranges[i].subject] = vm.exec(snapshot.iterator_at(subject.begin), snapshot.iterator_at(subject.end),
+                                     subject.flags | RegexExecFlags::Search |
+                                     RegexExecFlags::AnyMatch | RegexExecFlags::NoSaves);
+            }
+        }
+    });
+
+    Vector<Selection> result;
+    for (size_t i = 0; i < selections.size(); ++i)
+    {
+        if ((bool)matched[i] == matching)
+            result.push_back(selections[i]);
+    }
+    return result;
+}
+
 UnitTest test_find_surrounding{[]()
 {
     StringView s("[salut { toi[] }]");
@@ -1014,4 +1356,82 @@ UnitTest test_find_surrounding{[]()
     check_equal(s.begin() + 6, "begin", "end", ObjectFlags::ToBegin | ObjectFlags::ToEnd, 0, s);
 }};
 
+
+UnitTest test_parallel_regex_search{[]()
+{
+    String content;
+    for (int i = 0; i < 21; ++i)
+        content += format("line {} {}\n", i, i % 7 == 0 ? "foo(bar baz)" : "éà  qux");
+    Buffer buffer("test", Buffer::Flags::None, content);
+
+    auto check = [&](const SelectionList& selections, StringView re, int capture) {
+        Regex regex{re};
+        const auto sequential = find_matches(selections, regex, capture, true, 1);
+        const auto parallel = find_matches(selections, regex, capture, true, 3, 64);
+        kak_assert(sequential.size() == selections.size() and parallel.size() == selections.size());
+        for (size_t i = 0; i < selections.size(); ++i)
+        {
+            auto begin = buffer.iterator_at(selections[i].min());
+            auto end = utf8::next(buffer.iterator_at(selections[i].max()), buffer.end());
+            size_t count = 0;
+            for (RegexIterator<BufferIterator> it{begin, end, regex, match_flags(buffer, begin, end)}, it_end;
+                 it != it_end; ++it, ++count)
+            {
+                kak_assert(count < sequential[i].size());
+                kak_assert(sequential[i][count].begin == (*it)[0].first.coord() and
+                           sequential[i][count].end == (*it)[0].second.coord());
+            }
+            kak_assert(count == sequential[i].size() and count == parallel[i].size());
+            for (size_t j = 0; j < count; ++j)
+            {
+                auto& lhs = sequential[i][j];
+                auto& rhs = parallel[i][j];
+                kak_assert(lhs.begin == rhs.begin and lhs.end == rhs.end and
+                           lhs.captured == rhs.captured and lhs.captures == rhs.captures and
+                           lhs.capture_begin == rhs.capture_begin and lhs.capture_end == rhs.capture_end);
+            }
+        }
+    };
+
+    SelectionList whole{buffer, {{0, 0}, buffer.back_coord()}};
+    SelectionList several{buffer, {{{0, 0}, {5, 3}}, {{8, 4}, {15, 2}}, {{16, 0}, {20, 5}}}};
+    for (auto* selections : {&whole, &several})
+    {
+        for (auto re : {R"(\w+)", R"(^)", R"(o*)", R"(\Aline)", R"([^\n]*\n[^\n]*)",
+                        R"(foo)", R"((?i)FOO)", R"(.{80})", R"((?<=o)\w)"})
+            check(*selections, re, 0);
+        check(*selections, R"((foo)|(qux))", 2);
+    }
+
+    Regex qux{"qux"};
+    select_all_matches(several, qux, 0, 4);
+    kak_assert(several.size() == 14 and several[0].min() == BufferCoord(1, 13) and
+               several[0].captures()[0] == "qux");
+    kak_assert(keep_matching(several, Regex{"q"}, false, 4).empty());
+    kak_assert(keep_matching(several, Regex{"^"}, false, 4).size() == 14);
+    split_selections(whole, qux, 0, 4);
+    kak_assert(whole.size() == 19 and whole[1].min() == BufferCoord(1, 16));
+}};
+
+UnitTest test_interrupted_regex_search{[]()
+{
+    // The calling thread, done with its own tasks, keeps checking the
+    // interrupt that the workers follow
+    Buffer buffer("test", Buffer::Flags::None, "foo\n");
+    const auto calling_thread = std::this_thread::get_id();
+    RegexInterrupt interrupt{[] { return true; }};
+    try
+    {
+        run_workers(buffer.snapshot(), 2, 2, [&](const BufferSnapshot&, std::atomic<size_t>&) {
+            for (int i = 0; i < 1000 and std::this_thread::get_id() != calling_thread; ++i)
+            {
+                RegexInterrupt::poll();
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            }
+        });
+        kak_assert(false);
+    }
+    catch (regex_aborted&) {}
+}};
+
 }
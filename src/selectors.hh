@@ -104,8 +104,14 @@ template<MatchDirection direction>
 Selection find_next_match(const Context& context, const Selection& sel,
                           const Regex& regex, bool& wrapped);
 
-void select_all_matches(SelectionList& selections, const Regex& regex, int capture = 0);
-void split_selections(SelectionList& selections, const Regex& regex, int capture = 0);
+// These search the selections on up to thread_count threads, 0 meaning one
+// per core, with the same results whatever their number
+void select_all_matches(SelectionList& selections, const Regex& regex,
+                        int capture = 0, int thread_count = 1);
+void split_selections(SelectionList& selections, const Regex& regex,
+                      int capture = 0, int thread_count = 1);
+Vector<Selection> keep_matching(const SelectionList& selections, const Regex& regex,
+                                bool matching, int thread_count = 1);
 
 Optional<Selection>
 select_surrounding(const Context& context, const Selection& selection,
@@ -1,11 +1,29 @@
 #include "shared_string.hh"
 #include "buffer_utils.hh"
+#include "slab_allocator.hh"
 
 #include <cstring>
 
 namespace Kakoune
 {
 
+SlabAllocator& StringData::allocator()
+{
+    // Never destroyed, as static strings can outlive any other static object
+    static auto& allocator = *new SlabAllocator{Domain};
+    return allocator;
+}
+
+void* StringData::operator new(size_t size)
+{
+    return allocator().allocate(size);
+}
+
+void StringData::operator delete(void* ptr, size_t size)
+{
+    allocator().deallocate(ptr, size);
+}
+
 StringDataPtr StringData::create(ArrayView<const StringView> strs)
 {
     const int len = accumulate(strs, 0, [](int l, StringView s) {
@@ -35,6 +53,20 @@ StringDataPtr StringData::Registry::intern(StringView str)
     return data;
 }
 
+StringDataPtr StringData::Registry::intern(StringDataPtr str)
+{
+    if (str->refcount & interned_flag)
+        return str;
+
+    auto& interned = m_strings[str->strview()];
+    if (interned)
+        return StringDataPtr{interned};
+
+    str->refcount |= interned_flag;
+    interned = str.get();
+    return str;
+}
+
 void StringData::Registry::remove(StringView str)
 {
     kak_assert(m_strings.contains(str));
@@ -46,14 +78,23 @@ void StringData::Registry::debug_stats() const
     write_to_debug_buffer("Shared Strings stats:");
     size_t total_refcount = 0;
     size_t total_size = 0;
+    size_t duplicated_size = 0;
     size_t count = m_strings.size();
     for (auto& st : m_strings)
     {
-        total_refcount += st.value->refcount - 1;
+        const size_t refcount = st.value->refcount & refcount_mask;
+        const size_t size = sizeof(StringData) + st.value->length + 1;
+        total_refcount += refcount;
         total_size += (int)st.value->length;
+        duplicated_size += (refcount - 1) * size;
     }
+    write_to_debug_buffer(format("  count: {}", count));
     write_to_debug_buffer(format("  data size: {}, mean: {}", total_size, (float)total_size/count));
     write_to_debug_buffer(format("  refcounts: {}, mean: {}", total_refcount, (float)total_refcount/count));
+    // Strings can be shared for other reasons than interning, this assumes
+    // each reference would have its own copy otherwise.
+    write_to_debug_buffer(format("  dedup ratio: {}, memory saved: {}",
+                                 (float)total_refcount/count, duplicated_size));
 }
 
 }
@@ -11,6 +11,8 @@
 namespace Kakoune
 {
 
+class SlabAllocator;
+
 struct StringData : UseMemoryDomain<MemoryDomain::SharedString>
 {
     uint32_t refcount;
@@ -21,6 +23,12 @@ struct StringData : UseMemoryDomain<MemoryDomain::SharedString>
     [[gnu::always_inline]]
     StringView strview() const { return {data(), length}; }
 
+    // StringData are small and numerous, they are stored in slabs
+    static void* operator new(size_t size);
+    static void* operator new(size_t size, void* ptr) { return ptr; }
+    static void operator delete(void* ptr, size_t size);
+    static SlabAllocator& allocator();
+
 private:
     StringData(int len) : refcount(0), length(len) {}
 
@@ -50,6 +58,11 @@ public:
     public:
         void debug_stats() const;
         Ptr intern(StringView str);
+        // returns the interned string equal to str, interning str itself
+        // if there is none
+        Ptr intern(Ptr str);
+        // makes room for count more strings
+        void reserve(size_t count) { m_strings.reserve(m_strings.size() + count); }
         void remove(StringView str);
 
     private:
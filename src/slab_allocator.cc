@@ -0,0 +1,269 @@
+#include "slab_allocator.hh"
+
+#include "assert.hh"
+#include "buffer_utils.hh"
+#include "string_utils.hh"
+#include "unit_tests.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace Kakoune
+{
+
+// Slabs are aligned on their size so that the slab of an object can be
+// found from its address, their header is followed by the slots.
+struct SlabAllocator::Slab
+{
+    Slab* prev;
+    Slab* next;
+    void* free_list;     // slots that were deallocated
+    uint32_t used;       // allocated slots
+    uint32_t untouched;  // index of the first slot never allocated
+};
+
+constexpr size_t SlabAllocator::slab_size;
+constexpr size_t SlabAllocator::max_object_size;
+
+static constexpr size_t slab_header_size = 64;
+
+int SlabAllocator::size_class(size_t size)
+{
+    kak_assert(size > 0 and size <= max_object_size);
+    if (size <= 64)
+        return (int)(size + 7) / 8 - 1;
+    if (size <= 128)
+        return 8 + (int)(size - 65) / 16;
+    if (size <= 256)
+        return 12 + (int)(size - 129) / 32;
+    return 16 + (int)(size - 257) / 64;
+}
+
+size_t SlabAllocator::object_size(int size_class)
+{
+    if (size_class < 8)
+        return (size_class + 1) * 8;
+    if (size_class < 12)
+        return 64 + (size_class - 7) * 16;
+    if (size_class < 16)
+        return 128 + (size_class - 11) * 32;
+    return 256 + (size_class - 15) * 64;
+}
+
+size_t SlabAllocator::slot_count(int size_class)
+{
+    static_assert(sizeof(Slab) <= slab_header_size, "");
+    return (slab_size - slab_header_size) / object_size(size_class);
+}
+
+SlabAllocator::SlabAllocator(MemoryDomain domain)
+    : m_domain{domain}
+{
+    for (int index = 0; index < class_count; ++index)
+    {
+        m_classes[index].object_size = object_size(index);
+        m_classes[index].slot_count = slot_count(index);
+    }
+}
+
+SlabAllocator::~SlabAllocator()
+{
+    for (auto& size_class : m_classes)
+    {
+        kak_assert(size_class.used_slots == 0);
+        if (size_class.empty)
+        {
+            on_dealloc(m_domain, slab_size);
+            free(size_class.empty);
+        }
+    }
+}
+
+void SlabAllocator::link(SizeClass& size_class, Slab* slab)
+{
+    slab->prev = nullptr;
+    slab->next = size_class.available;
+    if (slab->next)
+        slab->next->prev = slab;
+    size_class.available = slab;
+}
+
+void SlabAllocator::unlink(SizeClass& size_class, Slab* slab)
+{
+    (slab->prev ? slab->prev->next : size_class.available) = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+}
+
+void* SlabAllocator::allocate(size_t size)
+{
+    if (size > max_object_size)
+    {
+        on_alloc(m_domain, size);
+        return ::operator new(size);
+    }
+
+    const int index = size_class(size);
+    auto& size_class = m_classes[index];
+    std::lock_guard<SpinLock> lock{size_class.lock};
+
+    Slab* slab = size_class.available;
+    if (not slab)
+    {
+        slab = size_class.empty;
+        size_class.empty = nullptr;
+        if (not slab)
+        {
+            void* memory = nullptr;
+            if (posix_memalign(&memory, slab_size, slab_size) != 0)
+                throw std::bad_alloc{};
+            on_alloc(m_domain, slab_size);
+            ++size_class.slab_count;
+            slab = new (memory) Slab{nullptr, nullptr, nullptr, 0, 0};
+        }
+        link(size_class, slab);
+    }
+
+    void* res;
+    if (slab->free_list)
+    {
+        res = slab->free_list;
+        slab->free_list = *reinterpret_cast<void**>(res);
+    }
+    else
+    {
+        kak_assert(slab->untouched < size_class.slot_count);
+        res = reinterpret_cast<char*>(slab) + slab_header_size + slab->untouched++ * size_class.object_size;
+    }
+
+    if (++slab->used == size_class.slot_count)
+        unlink(size_class, slab);
+
+    ++size_class.used_slots;
+    size_class.requested_bytes += size;
+    return res;
+}
+
+void SlabAllocator::deallocate(void* ptr, size_t size)
+{
+    if (size > max_object_size)
+    {
+        on_dealloc(m_domain, size);
+        ::operator delete(ptr);
+        return;
+    }
+
+    const int index = size_class(size);
+    auto& size_class = m_classes[index];
+    auto* slab = reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t)(slab_size - 1));
+    std::lock_guard<SpinLock> lock{size_class.lock};
+
+    kak_assert(slab->used > 0);
+    if (slab->used-- == size_class.slot_count)
+        link(size_class, slab);
+
+    *reinterpret_cast<void**>(ptr) = slab->free_list;
+    slab->free_list = ptr;
+
+    --size_class.used_slots;
+    size_class.requested_bytes -= size;
+
+    if (slab->used == 0)
+    {
+        unlink(size_class, slab);
+        if (size_class.empty)
+        {
+            on_dealloc(m_domain, slab_size);
+            --size_class.slab_count;
+            free(size_class.empty);
+        }
+        slab->free_list = nullptr;
+        slab->untouched = 0;
+        size_class.empty = slab;
+    }
+}
+
+Vector<SlabAllocator::Stats> SlabAllocator::stats() const
+{
+    Vector<Stats> res;
+    for (int index = 0; index < class_count; ++index)
+    {
+        auto& size_class = m_classes[index];
+        std::lock_guard<SpinLock> lock{size_class.lock};
+        if (size_class.slab_count != 0)
+            res.push_back({size_class.object_size, size_class.slab_count, size_class.used_slots,
+                           size_class.slab_count * size_class.slot_count, size_class.requested_bytes});
+    }
+    return res;
+}
+
+void SlabAllocator::write_debug_stats(StringView name) const
+{
+    size_t slab_count = 0, requested_bytes = 0;
+    auto all_stats = stats();
+    for (auto& stats : all_stats)
+    {
+        slab_count += stats.slab_count;
+        requested_bytes += stats.requested_bytes;
+    }
+    write_to_debug_buffer(format("  {} slabs: {} of {} bytes, {} bytes used", name, slab_count,
+                                 slab_size, requested_bytes));
+    for (auto& stats : all_stats)
+    {
+        const size_t bytes = stats.slab_count * slab_size;
+        write_to_debug_buffer(format("    {} bytes objects: {} slabs, {}/{} slots used, {}% fragmentation",
+                                     stats.object_size, stats.slab_count, stats.used_slots, stats.total_slots,
+                                     (int)(100 - 100 * stats.requested_bytes / bytes)));
+    }
+}
+
+UnitTest test_slab_allocator{[]()
+{
+    SlabAllocator allocator{MemoryDomain::Undefined};
+    Vector<std::pair<void*, size_t>> objects;
+    // every size up to max_object_size, enough of the largest ones for their
+    // classes to span several slabs, and a few that are too big for slabs
+    constexpr size_t max_size = SlabAllocator::max_object_size;
+    for (size_t i = 0; i < 816; ++i)
+    {
+        const size_t size = i < max_size ? i + 1
+                          : i < 800 ? max_size - 127 + (i * 7) % 128 : i;
+        auto* ptr = static_cast<char*>(allocator.allocate(size));
+        memset(ptr, (int)(i % 256), size);
+        objects.emplace_back(ptr, size);
+    }
+    for (size_t i = 0; i < objects.size(); ++i)
+        kak_assert(*static_cast<char*>(objects[i].first) == (char)(i % 256) and
+                   static_cast<char*>(objects[i].first)[objects[i].second-1] == (char)(i % 256));
+
+    auto stats = allocator.stats();
+    kak_assert(stats.size() == 20 and stats.front().object_size == 8 and stats.back().object_size == 512);
+
+    // free every other object, slabs stay half used
+    for (size_t i = 0; i < objects.size(); i += 2)
+        allocator.deallocate(objects[i].first, objects[i].second);
+    size_t slab_count = 0;
+    for (auto& s : allocator.stats())
+    {
+        kak_assert(s.used_slots * 2 <= s.total_slots);
+        slab_count += s.slab_count;
+    }
+
+    // freed slots are reused before new slabs are allocated
+    for (size_t i = 0; i < objects.size(); i += 2)
+        objects[i].first = allocator.allocate(objects[i].second);
+    size_t new_slab_count = 0;
+    for (auto& s : allocator.stats())
+        new_slab_count += s.slab_count;
+    kak_assert(new_slab_count == slab_count);
+
+    // empty slabs are released, except one per size class
+    for (auto& object : objects)
+        allocator.deallocate(object.first, object.second);
+    for (auto& s : allocator.stats())
+        kak_assert(s.slab_count == 1 and s.used_slots == 0 and s.requested_bytes == 0);
+}};
+
+}
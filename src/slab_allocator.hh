@@ -0,0 +1,98 @@
+#ifndef slab_allocator_hh_INCLUDED
+#define slab_allocator_hh_INCLUDED
+
+#include "memory.hh"
+#include "string.hh"
+#include "vector.hh"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace Kakoune
+{
+
+// Allocator for many small objects, such as buffer lines, that rounds
+// sizes up to a few size classes and stores objects of a given class in
+// large slabs. This avoids the per allocation overhead of malloc and
+// allows memory to be given back to the system as soon as a slab is empty.
+//
+// It is thread safe, each size class being protected by its own lock.
+class SlabAllocator
+{
+public:
+    SlabAllocator(MemoryDomain domain);
+    ~SlabAllocator();
+
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    static constexpr size_t slab_size = 64 * 1024;
+    // larger objects are allocated using operator new
+    static constexpr size_t max_object_size = 512;
+
+    void* allocate(size_t size);
+    void deallocate(void* ptr, size_t size);
+
+    struct Stats
+    {
+        size_t object_size;
+        size_t slab_count;
+        size_t used_slots;
+        size_t total_slots;
+        size_t requested_bytes;
+    };
+    // returns stats for each size class that has slabs
+    Vector<Stats> stats() const;
+
+    void write_debug_stats(StringView name) const;
+
+private:
+    struct Slab;
+
+    // Critical sections are a few instructions long, which makes a spin
+    // lock much cheaper than a mutex when uncontended.
+    class SpinLock
+    {
+    public:
+        void lock()
+        {
+            while (m_locked.exchange(true, std::memory_order_acquire))
+            {
+                while (m_locked.load(std::memory_order_relaxed))
+                    std::this_thread::yield();
+            }
+        }
+        void unlock() { m_locked.store(false, std::memory_order_release); }
+
+    private:
+        std::atomic<bool> m_locked{false};
+    };
+
+    struct SizeClass
+    {
+        mutable SpinLock lock;
+        size_t object_size = 0;
+        size_t slot_count = 0;
+        Slab* available = nullptr; // list of slabs having free slots
+        Slab* empty = nullptr;     // one empty slab kept to avoid thrashing
+        size_t slab_count = 0;
+        size_t used_slots = 0;
+        size_t requested_bytes = 0;
+    };
+
+    static constexpr int class_count = 20;
+    static int size_class(size_t size);
+    static size_t object_size(int size_class);
+    static size_t slot_count(int size_class);
+
+    void link(SizeClass& size_class, Slab* slab);
+    void unlink(SizeClass& size_class, Slab* slab);
+
+    const MemoryDomain m_domain;
+    SizeClass m_classes[class_count];
+};
+
+}
+
+#endif // slab_allocator_hh_INCLUDED
@@ -0,0 +1,263 @@
+#include "text_scan.hh"
+
+#include "assert.hh"
+#include "utf8.hh"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KAK_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace Kakoune
+{
+
+namespace
+{
+
+// Byte finding is not dispatched, glibc memchr is already vectorized and is
+// faster than a simple compare and movemask loop.
+struct ScanKernels
+{
+    size_t (*count_byte)(const char* begin, const char* end, char c);
+    const char* (*find_non_ascii)(const char* begin, const char* end);
+    size_t (*count_codepoints)(const char* begin, const char* end);
+};
+
+size_t count_byte_scalar(const char* begin, const char* end, char c)
+{
+    size_t count = 0;
+    for (; begin != end; ++begin)
+        count += *begin == c;
+    return count;
+}
+
+const char* find_non_ascii_scalar(const char* begin, const char* end)
+{
+    while (begin != end and (unsigned char)*begin < 0x80)
+        ++begin;
+    return begin;
+}
+
+size_t count_codepoints_scalar(const char* begin, const char* end)
+{
+    size_t count = 0;
+    for (; begin != end; ++begin)
+        count += utf8::is_character_start(*begin);
+    return count;
+}
+
+constexpr ScanKernels scalar_kernels{
+    count_byte_scalar, find_non_ascii_scalar, count_codepoints_scalar
+};
+
+#ifdef KAK_SCAN_X86
+
+// Counting kernels accumulate matches in per byte counters, which
+// are summed before they can overflow, every 255 iterations.
+
+[[gnu::target("sse2")]]
+inline size_t sum_counters_sse2(__m128i counters)
+{
+    const __m128i sums = _mm_sad_epu8(counters, _mm_setzero_si128());
+    return (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+}
+
+[[gnu::target("sse2")]]
+size_t count_byte_sse2(const char* begin, const char* end, char c)
+{
+    const __m128i pattern = _mm_set1_epi8(c);
+    size_t count = 0;
+    while (end - begin >= 16)
+    {
+        __m128i counters = _mm_setzero_si128();
+        for (int i = 0; i < 255 and end - begin >= 16; ++i, begin += 16)
+        {
+            const __m128i data = _mm_loadu_si128((const __m128i*)begin);
+            counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(data, pattern));
+        }
+        count += sum_counters_sse2(counters);
+    }
+    return count + count_byte_scalar(begin, end, c);
+}
+
+[[gnu::target("sse2")]]
+const char* find_non_ascii_sse2(const char* begin, const char* end)
+{
+    for (; end - begin >= 16; begin += 16)
+    {
+        if (int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)begin)))
+            return begin + __builtin_ctz(mask);
+    }
+    return find_non_ascii_scalar(begin, end);
+}
+
+[[gnu::target("sse2")]]
+size_t count_codepoints_sse2(const char* begin, const char* end)
+{
+    // continuation bytes are in [0x80, 0xBF], which is [-128, -65] as signed bytes
+    const __m128i last_continuation = _mm_set1_epi8(-65);
+    size_t count = 0;
+    while (end - begin >= 16)
+    {
+        __m128i counters = _mm_setzero_si128();
+        for (int i = 0; i < 255 and end - begin >= 16; ++i, begin += 16)
+        {
+            const __m128i data = _mm_loadu_si128((const __m128i*)begin);
+            counters = _mm_sub_epi8(counters, _mm_cmpgt_epi8(data, last_continuation));
+        }
+        count += sum_counters_sse2(counters);
+    }
+    return count + count_codepoints_scalar(begin, end);
+}
+
+constexpr ScanKernels sse2_kernels{
+    count_byte_sse2, find_non_ascii_sse2, count_codepoints_sse2
+};
+
+[[gnu::target("avx2")]]
+inline size_t sum_counters_avx2(__m256i counters)
+{
+    const __m256i sums256 = _mm256_sad_epu8(counters, _mm256_setzero_si256());
+    const __m128i sums = _mm_add_epi64(_mm256_castsi256_si128(sums256),
+                                       _mm256_extracti128_si256(sums256, 1));
+    return (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+}
+
+[[gnu::target("avx2")]]
+size_t count_byte_avx2(const char* begin, const char* end, char c)
+{
+    const __m256i pattern = _mm256_set1_epi8(c);
+    size_t count = 0;
+    while (end - begin >= 32)
+    {
+        __m256i counters = _mm256_setzero_si256();
+        for (int i = 0; i < 255 and end - begin >= 32; ++i, begin += 32)
+        {
+            const __m256i data = _mm256_loadu_si256((const __m256i*)begin);
+            counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(data, pattern));
+        }
+        count += sum_counters_avx2(counters);
+    }
+    return count + count_byte_sse2(begin, end, c);
+}
+
+[[gnu::target("avx2")]]
+const char* find_non_ascii_avx2(const char* begin, const char* end)
+{
+    for (; end - begin >= 32; begin += 32)
+    {
+        if (unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)begin)))
+            return begin + __builtin_ctz(mask);
+    }
+    return find_non_ascii_sse2(begin, end);
+}
+
+[[gnu::target("avx2")]]
+size_t count_codepoints_avx2(const char* begin, const char* end)
+{
+    const __m256i last_continuation = _mm256_set1_epi8(-65);
+    size_t count = 0;
+    while (end - begin >= 32)
+    {
+        __m256i counters = _mm256_setzero_si256();
+        for (int i = 0; i < 255 and end - begin >= 32; ++i, begin += 32)
+        {
+            const __m256i data = _mm256_loadu_si256((const __m256i*)begin);
+            counters = _mm256_sub_epi8(counters, _mm256_cmpgt_epi8(data, last_continuation));
+        }
+        count += sum_counters_avx2(counters);
+    }
+    return count + count_codepoints_sse2(begin, end);
+}
+
+constexpr ScanKernels avx2_kernels{
+    count_byte_avx2, find_non_ascii_avx2, count_codepoints_avx2
+};
+
+#endif
+
+const ScanKernels& kernels_for(ScanLevel level)
+{
+    switch (level)
+    {
+#ifdef KAK_SCAN_X86
+        case ScanLevel::Avx2: return avx2_kernels;
+        case ScanLevel::Sse2: return sse2_kernels;
+#endif
+        default: return scalar_kernels;
+    }
+}
+
+std::atomic<const ScanKernels*> current_kernels{nullptr};
+
+[[gnu::always_inline]]
+inline const ScanKernels& kernels()
+{
+    // Selected on first use as this can be called during static initialization
+    auto* res = current_kernels.load(std::memory_order_relaxed);
+    if (not res)
+    {
+        res = &kernels_for(supported_scan_level());
+        current_kernels.store(res, std::memory_order_relaxed);
+    }
+    return *res;
+}
+
+}
+
+ScanLevel supported_scan_level()
+{
+#ifdef KAK_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ScanLevel::Avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return ScanLevel::Sse2;
+#endif
+    return ScanLevel::Scalar;
+}
+
+void set_scan_level(ScanLevel level)
+{
+    kak_assert(level <= supported_scan_level());
+    current_kernels.store(&kernels_for(level), std::memory_order_relaxed);
+}
+
+const char* find_byte(const char* begin, const char* end, char c)
+{
+    auto* res = static_cast<const char*>(memchr(begin, c, end - begin));
+    return res ? res : end;
+}
+
+size_t count_byte(const char* begin, const char* end, char c)
+{
+    return kernels().count_byte(begin, end, c);
+}
+
+const char* find_non_ascii(const char* begin, const char* end)
+{
+    return kernels().find_non_ascii(begin, end);
+}
+
+size_t count_codepoints(const char* begin, const char* end)
+{
+    return kernels().count_codepoints(begin, end);
+}
+
+char* remove_byte(const char* begin, const char* end, char* out, char c)
+{
+    while (begin != end)
+    {
+        const char* next = find_byte(begin, end, c);
+        if (out != begin)
+            memmove(out, begin, next - begin);
+        out += next - begin;
+        begin = next == end ? end : next + 1;
+    }
+    return out;
+}
+
+}
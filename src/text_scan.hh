@@ -0,0 +1,38 @@
+#ifndef text_scan_hh_INCLUDED
+#define text_scan_hh_INCLUDED
+
+#include <cstddef>
+
+namespace Kakoune
+{
+
+// Byte scanning kernels for buffer and file contents. They use SSE2 or AVX2
+// instructions when the cpu supports them, and a scalar loop otherwise.
+// find_byte and remove_byte rely on memchr at every level.
+
+// returns a pointer to the first c byte in [begin, end), or end
+const char* find_byte(const char* begin, const char* end, char c);
+// returns the number of c bytes in [begin, end)
+size_t count_byte(const char* begin, const char* end, char c);
+// returns a pointer to the first byte that is not ascii in [begin, end), or end
+const char* find_non_ascii(const char* begin, const char* end);
+// returns the number of utf8 character first bytes in [begin, end)
+size_t count_codepoints(const char* begin, const char* end);
+// copies [begin, end) to out skipping c bytes, out can be begin.
+// returns the end of the copied data
+char* remove_byte(const char* begin, const char* end, char* out, char c);
+
+enum class ScanLevel
+{
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+// best level supported by the cpu, used unless set_scan_level is called
+ScanLevel supported_scan_level();
+void set_scan_level(ScanLevel level);
+
+}
+
+#endif // text_scan_hh_INCLUDED
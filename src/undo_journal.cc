@@ -0,0 +1,219 @@
+#include "undo_journal.hh"
+
+#include "file.hh"
+#include "string_utils.hh"
+#include "unit_tests.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Kakoune
+{
+
+static constexpr StringView journal_magic = "kakundo1";
+
+UndoJournal::~UndoJournal()
+{
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+static bool write_at(int fd, const char* data, size_t size, size_t offset)
+{
+    while (size != 0)
+    {
+        ssize_t count = pwrite(fd, data, size, (off_t)offset);
+        if (count == -1 and errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        data += count;
+        offset += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool UndoJournal::open(StringView path, StringView key)
+{
+    kak_assert(m_fd == -1);
+    m_fd = ::open(path.zstr(), O_RDWR | O_CREAT, 0600);
+    if (m_fd == -1)
+        return false;
+    fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+
+    // Each session appends at its own end of the file
+    if (flock(m_fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    String header = journal_magic + key + "\n";
+    m_header_size = (int)header.length();
+
+    struct stat st;
+    if (fstat(m_fd, &st) == 0 and (size_t)st.st_size >= m_header_size)
+    {
+        String existing;
+        existing.resize(header.length(), 0);
+        if (pread(m_fd, existing.data(), m_header_size, 0) == (ssize_t)m_header_size and
+            existing == header)
+        {
+            m_size = (size_t)st.st_size;
+            return true;
+        }
+    }
+
+    m_size = 0;
+    if (ftruncate(m_fd, 0) != 0 or not write_at(m_fd, header.data(), m_header_size, 0))
+    {
+        close(m_fd);
+        m_fd = -1;
+        m_header_size = 0;
+        return false;
+    }
+    m_size = m_header_size;
+    return true;
+}
+
+Optional<UndoJournal::Location> UndoJournal::write(StringView data)
+{
+    if (m_fd == -1)
+    {
+        String path = format("{}/kak-undo-XXXXXX", tmpdir());
+        m_fd = mkstemp(path.data());
+        if (m_fd == -1)
+            return {};
+        unlink(path.c_str());
+        fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    Location location{m_size, (size_t)(int)data.length()};
+    if (not write_at(m_fd, data.data(), location.size, location.offset))
+        return {};
+    m_size += location.size;
+    return location;
+}
+
+Optional<String> UndoJournal::read(Location location) const
+{
+    String data;
+    data.resize(ByteCount{(int)location.size}, 0);
+    size_t done = 0;
+    while (done != location.size)
+    {
+        ssize_t count = pread(m_fd, data.data() + done, location.size - done,
+                              (off_t)(location.offset + done));
+        if (count == -1 and errno == EINTR)
+            continue;
+        if (count <= 0)
+            return {};
+        done += count;
+    }
+    return data;
+}
+
+Optional<UndoJournal::Location> UndoJournal::write_record(const Record& record, StringView payload)
+{
+    kak_assert(persistent() and record.payload_size == (int)payload.length());
+    // Write the payload first, so that a record header is always complete
+    const size_t offset = m_size;
+    Location location{offset + sizeof(Record), (size_t)(int)payload.length()};
+    if (not write_at(m_fd, payload.data(), location.size, location.offset) or
+        not write_at(m_fd, (const char*)&record, sizeof(Record), offset))
+        return {};
+    m_size = location.offset + location.size;
+    return location;
+}
+
+Vector<std::pair<UndoJournal::Record, UndoJournal::Location>> UndoJournal::records()
+{
+    kak_assert(persistent());
+    Vector<std::pair<Record, Location>> res;
+    if (m_size == m_header_size)
+        return res;
+
+    // Only the pages holding record headers get read
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (data == MAP_FAILED)
+        return res;
+
+    res = parse_records({(const char*)data, (const char*)data + m_size}, m_header_size);
+    munmap(data, m_size);
+
+    const size_t end = res.empty() ? m_header_size
+                                   : res.back().second.offset + res.back().second.size;
+    if (end != m_size and ftruncate(m_fd, (off_t)end) == 0)
+        m_size = end;
+    return res;
+}
+
+Vector<std::pair<UndoJournal::Record, UndoJournal::Location>>
+UndoJournal::parse_records(StringView data, size_t offset)
+{
+    Vector<std::pair<Record, Location>> res;
+    const size_t size = (size_t)(int)data.length();
+    while (offset + sizeof(Record) <= size)
+    {
+        Record record;
+        memcpy(&record, data.data() + offset, sizeof(Record));
+        const size_t end = offset + sizeof(Record) + record.payload_size;
+        if (record.type > Record::Save or end > size)
+            break;
+        res.emplace_back(record, Location{offset + sizeof(Record), record.payload_size});
+        offset = end;
+    }
+    return res;
+}
+
+bool UndoJournal::clear()
+{
+    kak_assert(persistent());
+    if (ftruncate(m_fd, (off_t)m_header_size) != 0)
+        return false;
+    m_size = m_header_size;
+    return true;
+}
+
+UnitTest test_undo_journal{[]()
+{
+    using Record = UndoJournal::Record;
+    String data = "header\n";
+    auto append = [&](const Record& record, StringView payload) {
+        data.append((const char*)&record, sizeof(Record));
+        data += payload;
+    };
+    append({Record::Root, 0, 0, 42}, {});
+    append({Record::Node, 3, 1, 0}, "abc");
+    append({Record::Save, 0, 1, 43}, {});
+
+    auto records = UndoJournal::parse_records(data, 7);
+    kak_assert(records.size() == 3);
+    kak_assert(records[1].first.type == Record::Node and records[1].first.id == 1 and
+               records[1].second.offset == 7 + 2 * sizeof(Record) and
+               records[1].second.size == 3);
+    kak_assert(records[2].first.type == Record::Save and records[2].first.value == 43);
+
+    // a torn write leaves incomplete data that gets dropped
+    const size_t complete = (size_t)(int)data.length();
+    data += "garbage";
+    kak_assert(UndoJournal::parse_records(data, 7).size() == 3);
+    kak_assert(UndoJournal::parse_records(data.substr(0_byte, (int)complete - 1), 7).size() == 2);
+
+    // so is a payload going past the end, or an unknown record type
+    data.resize((int)complete, 0);
+    append({Record::Node, 100, 2, 1}, "abc");
+    kak_assert(UndoJournal::parse_records(data, 7).size() == 3);
+    data.resize((int)complete, 0);
+    append({(Record::Type)3, 0, 2, 1}, {});
+    kak_assert(UndoJournal::parse_records(data, 7).size() == 3);
+}};
+
+}
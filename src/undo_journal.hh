@@ -0,0 +1,81 @@
+#ifndef undo_journal_hh_INCLUDED
+#define undo_journal_hh_INCLUDED
+
+#include "optional.hh"
+#include "string.hh"
+#include "vector.hh"
+
+#include <cstdint>
+
+namespace Kakoune
+{
+
+// An UndoJournal stores undo history data that does not need to stay in
+// memory.
+//
+// Temporary journals are unlinked files created on first write, holding
+// raw data. Persistent journals are opened at a given path, and made of a
+// header followed by records, each record header being followed by its
+// payload. They are only appended to, so that the history can be read
+// back record by record, with payloads only read when needed.
+class UndoJournal
+{
+public:
+    struct Location
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    struct Record
+    {
+        enum Type : uint32_t
+        {
+            Root, // id of the history root, value is the file content key
+            Node, // value is the parent id, payload is the undo group
+            Save  // value is the file content key when saved at id
+        };
+
+        Type type;
+        uint32_t payload_size;
+        uint64_t id;
+        uint64_t value;
+    };
+
+    UndoJournal() = default;
+    UndoJournal(const UndoJournal&) = delete;
+    UndoJournal& operator=(const UndoJournal&) = delete;
+    ~UndoJournal();
+
+    // Opens or creates the persistent journal at path for the given key,
+    // existing journals with a different key are cleared. Fails if another
+    // journal has it open.
+    bool open(StringView path, StringView key);
+    bool persistent() const { return m_header_size != 0; }
+
+    // returns an empty optional if data could not be written
+    Optional<Location> write(StringView data);
+    Optional<String> read(Location location) const;
+
+    // Returns the payload location of the written record
+    Optional<Location> write_record(const Record& record, StringView payload = {});
+    // Returns the complete records with their payload location, dropping
+    // any incomplete trailing data
+    Vector<std::pair<Record, Location>> records();
+    // Returns the records read from offset in data, up to the first
+    // incomplete or invalid one
+    static Vector<std::pair<Record, Location>> parse_records(StringView data, size_t offset);
+    // Drops all records
+    bool clear();
+
+    size_t size() const { return m_size; }
+
+private:
+    int m_fd = -1;
+    size_t m_size = 0;
+    size_t m_header_size = 0;
+};
+
+}
+
+#endif // undo_journal_hh_INCLUDED
@@ -4,6 +4,8 @@
 #include "diff.hh"
 #include "utf8.hh"
 #include "string.hh"
+#include "string_utils.hh"
+#include "text_scan.hh"
 
 namespace Kakoune
 {
@@ -52,6 +54,112 @@ UnitTest test_diff{[]()
         auto diff = find_diff(s1.begin(), (int)s1.length(), s2.begin(), (int)s2.length());
         kak_assert(diff.size() == 11);
     }
+
+    auto apply = [](StringView a, StringView b, ConstArrayView<Diff> diffs) {
+        String res;
+        int pos = 0;
+        for (auto& diff : diffs)
+        {
+            if (diff.mode == Diff::Keep)
+                res += a.substr(ByteCount{pos}, ByteCount{diff.len});
+            else if (diff.mode == Diff::Add)
+                res += b.substr(ByteCount{diff.posB}, ByteCount{diff.len});
+            if (diff.mode != Diff::Add)
+                pos += diff.len;
+        }
+        return res;
+    };
+
+    {
+        StringView s1 = "abcdefabcxyz";
+        StringView s2 = "abcabcdexyzf";
+        auto diff = find_diff_hashed(s1.begin(), (int)s1.length(), s2.begin(), (int)s2.length());
+        kak_assert(apply(s1, s2, diff) == s2);
+        kak_assert(eq(diff.front(), {Diff::Keep, 3, 0}));
+    }
+
+    {
+        // unique lines are kept even if duplicated ones move around them
+        StringView lines1[] = { "{", "foo", "}", "{", "bar", "}", "{", "baz", "}" };
+        StringView lines2[] = { "{", "baz", "}", "{", "foo", "}", "{", "bar", "}" };
+        auto diff = find_diff_hashed(std::begin(lines1), 9, std::begin(lines2), 9);
+        kak_assert(diff.size() == 5 and
+                   eq(diff[0], {Diff::Keep, 1, 0}) and
+                   eq(diff[1], {Diff::Add, 3, 1}) and
+                   eq(diff[2], {Diff::Keep, 4, 0}) and
+                   eq(diff[3], {Diff::Remove, 3, 0}) and
+                   eq(diff[4], {Diff::Keep, 1, 0}));
+    }
+
+    {
+        // small bytewise limit so that the linewise path is taken, changed
+        // lines being diffed bytewise or replaced depending on their length
+        String s1, s2;
+        for (int i = 0; i < 40; ++i)
+        {
+            s1 += format("line {}\n", i);
+            s2 += (i % 10 == 0) ? format("changed {}\n", i) : format("line {}\n", i);
+            if (i % 15 == 0)
+                s2 += "added\n";
+        }
+        s2 += String{'x', CharCount{80}} + "\n";
+        auto diff = find_text_diff(s1, s2, 64);
+        kak_assert(apply(s1, s2, diff) == s2);
+    }
+}};
+
+UnitTest test_text_scan{[]()
+{
+    // Mix of ascii, end of lines and multibyte characters, followed by enough
+    // end of lines for the counting kernels to flush their per byte counters
+    String data;
+    const StringView pieces[] = { "abc", "\n", "\r\n", "é", "€", "𝄞", " ", "\n\n\n" };
+    for (unsigned i = 0, seed = 1; i < 400; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        data += pieces[(seed >> 16) % 8];
+    }
+    data += String{'\n', CharCount{8200}};
+
+    auto check = [](const char* begin, const char* end) {
+        size_t lf = 0, cp = 0;
+        const char* first_lf = end;
+        const char* first_non_ascii = end;
+        String without_cr;
+        for (auto it = begin; it != end; ++it)
+        {
+            if (*it == '\n' and lf++ == 0)
+                first_lf = it;
+            if ((unsigned char)*it >= 0x80 and first_non_ascii == end)
+                first_non_ascii = it;
+            if (utf8::is_character_start(*it))
+                ++cp;
+            if (*it != '\r')
+                without_cr.push_back(*it);
+        }
+        kak_assert(find_byte(begin, end, '\n') == first_lf);
+        kak_assert(count_byte(begin, end, '\n') == lf);
+        kak_assert(find_non_ascii(begin, end) == first_non_ascii);
+        kak_assert(count_codepoints(begin, end) == cp);
+        String copy{begin, end};
+        kak_assert(StringView{copy.begin(), remove_byte(copy.begin(), copy.end(), copy.data(), '\r')} == without_cr);
+    };
+
+    const ScanLevel supported = supported_scan_level();
+    for (auto level : { ScanLevel::Scalar, ScanLevel::Sse2, ScanLevel::Avx2 })
+    {
+        if (level > supported)
+            continue;
+        set_scan_level(level);
+        // kernels use unaligned loads, a few offsets vary the content
+        for (int offset = 0; offset < 4; ++offset)
+        {
+            for (int len = 0; len < 100; ++len)
+                check(data.begin() + offset, data.begin() + offset + len);
+        }
+        check(data.begin() + 1, data.end());
+    }
+    set_scan_level(supported);
 }};
 
 UnitTest* UnitTest::list = nullptr;
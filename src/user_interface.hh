@@ -73,6 +73,9 @@ public:
     virtual void refresh(bool force) = 0;
 
     virtual void set_on_key(OnKeyCallback callback) = 0;
+    // passes the keys already received to the on key callback, without
+    // waiting for more nor handling other events
+    virtual void read_available_keys() = 0;
 
     using Options = HashMap<String, String, MemoryDomain::Options>;
     virtual void set_ui_options(const Options& options) = 0;
@@ -2,6 +2,7 @@
 #define utf8_hh_INCLUDED
 
 #include "assert.hh"
+#include "text_scan.hh"
 #include "unicode.hh"
 #include "units.hh"
 
@@ -235,6 +236,18 @@ CharCount distance(Iterator begin, const Iterator& end) noexcept
     return dist;
 }
 
+inline CharCount distance(const char* begin, const char* end) noexcept
+{
+    // Short strings are not worth a call to the vectorized kernel
+    if (end - begin >= 32)
+        return (int)count_codepoints(begin, end);
+
+    CharCount dist = 0;
+    for (; begin != end; ++begin)
+        dist += is_character_start(*begin) ? 1 : 0;
+    return dist;
+}
+
 // returns the column count between begin and end
 template<typename Iterator>
 ColumnCount column_distance(Iterator begin, const Iterator& end) noexcept
@@ -126,6 +126,15 @@ public:
 
     const BaseIt& base() const noexcept(noexcept_policy) { return m_it; }
 
+    // moves the base iterator by count bytes, which must end on a codepoint
+    // start
+    iterator& skip_bytes(int count) noexcept
+    {
+        m_it += count;
+        invalidate_value();
+        return *this;
+    }
+
 private:
     void invalidate_value() noexcept { m_value = -1; }
     CodepointType get_value() const noexcept(noexcept_policy)
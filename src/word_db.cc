@@ -2,7 +2,8 @@
 
 #include "utils.hh"
 #include "line_modification.hh"
-#include "utf8_iterator.hh"
+#include "text_scan.hh"
+#include "utf8.hh"
 #include "unit_tests.hh"
 
 namespace Kakoune
@@ -16,17 +17,43 @@ static WordList get_words(StringView content, ConstArrayView<Codepoint> extra_wo
     auto is_word = [&](Codepoint c) {
         return Kakoune::is_word(c) or contains(extra_word_chars, c);
     };
-    for (utf8::iterator<const char*> it{content.begin(), content};
-         it != content.end(); ++it)
+    auto is_ascii_word = [&](Codepoint c) {
+        return is_basic_alpha(c) or (c >= '0' and c <= '9') or c == '_' or
+               contains(extra_word_chars, c);
+    };
+
+    // Ascii runs are classified byte per byte, without decoding them
+    const char* pos = content.begin();
+    const char* end = content.end();
+    const char* ascii_end = pos;
+    const char* word = nullptr;
+    while (pos != end)
     {
-        if (is_word(*it))
+        if (pos == ascii_end)
+            ascii_end = find_non_ascii(pos, end);
+
+        const char* next = pos;
+        bool in_word;
+        if (pos != ascii_end)
+            in_word = is_ascii_word(*next++);
+        else
+        {
+            in_word = is_word(utf8::codepoint(pos, end));
+            utf8::to_next(next, end);
+            ascii_end = next;
+        }
+
+        if (in_word and not word)
+            word = pos;
+        else if (not in_word and word)
         {
-            const char* word = it.base(); 
-            while (++it != content.end() and is_word(*it))
-            {}
-            res.emplace_back(word, it.base());
+            res.emplace_back(word, pos);
+            word = nullptr;
         }
+        pos = next;
     }
+    if (word)
+        res.emplace_back(word, end);
     return res;
 }
 
@@ -67,6 +94,7 @@ WordDB::WordDB(const Buffer& buffer)
 {
     buffer.options().register_watcher(*this);
     rebuild_db();
+    buffer.register_change_checkpoint(m_timestamp);
 }
 
 WordDB::WordDB(WordDB&& other) noexcept
@@ -77,15 +105,20 @@ WordDB::WordDB(WordDB&& other) noexcept
 {
     kak_assert(m_buffer);
     m_buffer->options().unregister_watcher(other);
+    m_buffer->unregister_change_checkpoint(other.m_timestamp);
     other.m_buffer = nullptr;
 
     m_buffer->options().register_watcher(*this);
+    m_buffer->register_change_checkpoint(m_timestamp);
 }
 
 WordDB::~WordDB()
 {
     if (m_buffer)
+    {
         m_buffer->options().unregister_watcher(*this);
+        m_buffer->unregister_change_checkpoint(m_timestamp);
+    }
 }
 
 void WordDB::rebuild_db()
@@ -107,6 +140,9 @@ void WordDB::update_db()
 {
     auto& buffer = *m_buffer;
 
+    if (buffer.changes_discarded(m_timestamp))
+        return rebuild_db();
+
     auto modifs = compute_line_modifications(buffer, m_timestamp);
     m_timestamp = buffer.timestamp();
 